@@ -11,29 +11,18 @@ CONFIG += c++17
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
-    moveleditor.cpp \
-    widget/command.cpp \
-    widget/commandeditor.cpp \
-    widget/commandeditorpanel.cpp \
-    widget/commandmodel.cpp \
-    widget/commandtreeview.cpp
+    moveleditor.cpp
 
 HEADERS += \
     hyprgcommand.h \
     mainwindow.h \
-    moveleditor.h \
-    widget/command.h \
-    widget/commandeditor.h \
-    widget/commandeditorpanel.h \
-    widget/commandmodel.h \
-    widget/commandnode.h \
-    widget/commandrowwidget.h \
-    widget/commandtreeview.h \
-    widget/rowdelegate.h
+    moveleditor.h
 
 FORMS += \
     mainwindow.ui
 
+include(widget/widget.pri)
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
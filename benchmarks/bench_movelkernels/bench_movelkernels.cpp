@@ -0,0 +1,140 @@
+// movel:: kernels over 1M MoveL targets. The kernel columns run whichever
+// implementation this build compiled in (printed in the header); build once
+// with DEFINES += RP_NO_SIMD for the scalar path and once with -mavx for AVX.
+//
+// Columns:
+//   naive   the loop the kernels replaced: one pass over the commands,
+//           reading coordinates through the virtual Command::param() (and
+//           writing speeds through Command::setParam() for clampSpeeds)
+//   kernel  the same pass over MoveLArrays-style x/y/z/speed arrays
+// Both clampSpeeds columns include restoring the speeds before each run.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "hyprgcommand.h"
+#include "movelkernels.h"
+
+using namespace rp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int kPoints = 1000000;
+constexpr int kRepeats = 20;
+
+volatile double g_sink = 0;
+
+// best of kRepeats, in ms
+template <class F>
+double bestMs(F f) {
+  double best = 1e300;
+  for (int r = 0; r < kRepeats; ++r) {
+    const auto t0 = Clock::now();
+    g_sink = g_sink + f();
+    const auto t1 = Clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+  }
+  return best;
+}
+
+double naivePathLength(const std::vector<CommandPtr>& cmds) {
+  double sum = 0;
+  for (std::size_t i = 0; i + 1 < cmds.size(); ++i) {
+    const double dx = cmds[i + 1]->param(0) - cmds[i]->param(0);
+    const double dy = cmds[i + 1]->param(1) - cmds[i]->param(1);
+    const double dz = cmds[i + 1]->param(2) - cmds[i]->param(2);
+    sum += std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+  return sum;
+}
+
+double naiveMaxStep(const std::vector<CommandPtr>& cmds) {
+  double best = 0;
+  for (std::size_t i = 0; i + 1 < cmds.size(); ++i) {
+    const double dx = cmds[i + 1]->param(0) - cmds[i]->param(0);
+    const double dy = cmds[i + 1]->param(1) - cmds[i]->param(1);
+    const double dz = cmds[i + 1]->param(2) - cmds[i]->param(2);
+    best = std::max(best, std::sqrt(dx * dx + dy * dy + dz * dz));
+  }
+  return best;
+}
+
+double naiveBounds(const std::vector<CommandPtr>& cmds) {
+  double lo[3] = {1e300, 1e300, 1e300}, hi[3] = {-1e300, -1e300, -1e300};
+  for (const CommandPtr& c : cmds) {
+    for (int k = 0; k < 3; ++k) {
+      lo[k] = std::min(lo[k], c->param(k));
+      hi[k] = std::max(hi[k], c->param(k));
+    }
+  }
+  return hi[0] - lo[0] + hi[1] - lo[1] + hi[2] - lo[2];
+}
+
+std::size_t naiveClamp(const std::vector<CommandPtr>& cmds, double lo, double hi) {
+  std::size_t changed = 0;
+  for (const CommandPtr& c : cmds) {
+    const double s = c->param(3);
+    const double v = std::min(std::max(s, lo), hi);
+    if (v != s) { c->setParam(3, v); ++changed; }
+  }
+  return changed;
+}
+
+}
+
+int main() {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> coord(-1000.0, 1000.0), feed(0.0, 500.0);
+
+  std::vector<CommandPtr> cmds;
+  std::vector<double> x(kPoints), y(kPoints), z(kPoints), speed(kPoints);
+  cmds.reserve(kPoints);
+  for (int i = 0; i < kPoints; ++i) {
+    CommandPtr c = makePooled<HyMoveLCommand>();
+    x[i] = coord(rng); y[i] = coord(rng); z[i] = coord(rng); speed[i] = feed(rng);
+    c->setParam(0, x[i]); c->setParam(1, y[i]); c->setParam(2, z[i]); c->setParam(3, speed[i]);
+    cmds.push_back(std::move(c));
+  }
+  // every repeat clamps the same data
+  std::vector<double> work(kPoints);
+  auto reset = [&] { std::copy(speed.begin(), speed.end(), work.begin()); };
+  auto resetCommands = [&] {
+    for (int i = 0; i < kPoints; ++i) cmds[i]->setParam(3, speed[i]);
+  };
+
+  std::printf("%d points, kernels: %s\n", kPoints, movel::implementation());
+  std::printf("%14s %10s %10s %8s   (ms, best of %d)\n", "pass", "naive", "kernel", "speedup", kRepeats);
+  auto row = [](const char* name, double naive, double kernel) {
+    std::printf("%14s %10.2f %10.2f %7.1fx\n", name, naive, kernel, naive / kernel);
+  };
+
+  row("pathLength",
+      bestMs([&] { return naivePathLength(cmds); }),
+      bestMs([&] { return movel::pathLength(x.data(), y.data(), z.data(), kPoints); }));
+  row("maxStep",
+      bestMs([&] { return naiveMaxStep(cmds); }),
+      bestMs([&] { return movel::maxStep(x.data(), y.data(), z.data(), kPoints); }));
+  row("bounds",
+      bestMs([&] { return naiveBounds(cmds); }),
+      bestMs([&] { return movel::bounds(x.data(), y.data(), z.data(), kPoints).maxX; }));
+  row("clampSpeeds",
+      bestMs([&] { resetCommands(); return double(naiveClamp(cmds, 100.0, 400.0)); }),
+      bestMs([&] { reset(); return double(movel::clampSpeeds(work.data(), kPoints, 100.0, 400.0)); }));
+
+  std::vector<double> seg(kPoints);
+  row("segmentLengths",
+      bestMs([&] {
+        for (std::size_t i = 0; i + 1 < cmds.size(); ++i) {
+          const double dx = cmds[i + 1]->param(0) - cmds[i]->param(0);
+          const double dy = cmds[i + 1]->param(1) - cmds[i]->param(1);
+          const double dz = cmds[i + 1]->param(2) - cmds[i]->param(2);
+          seg[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        return seg[0];
+      }),
+      bestMs([&] { movel::segmentLengths(x.data(), y.data(), z.data(), kPoints, seg.data()); return seg[0]; }));
+  return g_sink == 42 ? 1 : 0;
+}
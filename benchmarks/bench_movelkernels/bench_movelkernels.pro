@@ -0,0 +1,15 @@
+QT -= gui
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_movelkernels
+INCLUDEPATH += ../.. ../../widget
+
+# scalar path: qmake "DEFINES+=RP_NO_SIMD"; AVX: qmake "QMAKE_CXXFLAGS+=-mavx"
+SOURCES += \
+    bench_movelkernels.cpp \
+    ../../widget/command.cpp \
+    ../../widget/movelkernels.cpp \
+    ../../widget/nametable.cpp \
+    ../../widget/slabpool.cpp
@@ -0,0 +1,75 @@
+// Cost of keeping block totals current while editing a wide block: one
+// block of n MoveL under the root, a random MoveL edited, then the program
+// totals read back.
+//
+// Columns:
+//   edit       setParam + markAggregateDirty + root aggregate()
+//   recombine  the former cost of the same edit: the block's totals rebuilt
+//              from every child's summary
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "commandnode.h"
+#include "hyprgcommand.h"
+
+using namespace rp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int kEdits = 10000;
+
+volatile double g_sink = 0;
+
+double usSince(Clock::time_point t0, int calls) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / calls;
+}
+
+}
+
+int main() {
+  std::printf("sizeof(CommandNode) = %zu bytes\n", sizeof(CommandNode));
+  std::printf("%10s %12s %12s   (us per edit)\n", "children", "edit", "recombine");
+  for (int n : {1000, 10000, 100000, 1000000}) {
+    CommandNode root{CommandPtr{}};
+    auto block = std::make_unique<CommandNode>(makePooled<HyIfCommand>());
+    std::vector<std::unique_ptr<CommandNode>> moves;
+    moves.reserve(n);
+    for (int i = 0; i < n; ++i) {
+      CommandPtr c = makePooled<HyMoveLCommand>();
+      c->setParam(0, i);
+      moves.push_back(std::make_unique<CommandNode>(c));
+    }
+    block->insertChildren(0, std::move(moves));
+    CommandNode* b = block.get();
+    root.appendChild(std::move(block));
+    g_sink = root.aggregate().pathLength;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    std::vector<CommandNode*> targets(kEdits);
+    for (CommandNode*& t : targets) t = b->child(pick(rng));
+
+    auto t0 = Clock::now();
+    for (int i = 0; i < kEdits; ++i) {
+      targets[i]->command()->setParam(1, i);
+      targets[i]->markAggregateDirty();
+      g_sink = g_sink + root.aggregate().pathLength;
+    }
+    const double edit = usSince(t0, kEdits);
+
+    const int recombines = std::max(1, kEdits * 1000 / n);
+    t0 = Clock::now();
+    for (int i = 0; i < recombines; ++i) {
+      NodeAggregate total = NodeAggregate::of(b->command().get());
+      for (int r = 0; r < n; ++r) total.append(b->child(r)->aggregate());
+      g_sink = g_sink + total.pathLength;
+    }
+    const double recombine = usSince(t0, recombines);
+
+    std::printf("%10d %12.2f %12.2f\n", n, edit, recombine);
+  }
+  return g_sink == 42 ? 1 : 0;
+}
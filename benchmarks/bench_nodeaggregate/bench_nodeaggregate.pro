@@ -0,0 +1,14 @@
+QT -= gui
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_nodeaggregate
+INCLUDEPATH += ../.. ../../widget
+
+SOURCES += \
+    bench_nodeaggregate.cpp \
+    ../../widget/childsource.cpp \
+    ../../widget/command.cpp \
+    ../../widget/nametable.cpp \
+    ../../widget/slabpool.cpp
@@ -0,0 +1,79 @@
+// Building and freeing a program of 1M rows: 1000 If blocks of 999 MoveL
+// each. Counts what reaches the global allocator (calls and bytes) by
+// replacing operator new, and times both phases.
+//
+// The source also builds against revisions without the slab pools (no
+// slabpool.h), where commands come from std::make_shared: that is the
+// "before" of the pooled allocation.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include "commandnode.h"
+#include "hyprgcommand.h"
+
+using namespace rp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+std::size_t g_calls = 0;
+std::size_t g_bytes = 0;
+
+constexpr int kBlocks = 1000;
+constexpr int kMovesPerBlock = 999;
+
+template <class T>
+std::shared_ptr<Command> makeCommand() {
+#if __has_include("slabpool.h")
+  return makePooled<T>();
+#else
+  return std::make_shared<T>();
+#endif
+}
+
+double msSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+}
+
+void* operator new(std::size_t size) {
+  ++g_calls;
+  g_bytes += size;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main() {
+  std::printf("%6s %10s %12s %10s %10s\n", "pass", "build ms", "allocations", "MB", "free ms");
+  // the second pass shows recycling: pools keep their slabs for reuse
+  for (int pass = 1; pass <= 2; ++pass) {
+    const std::size_t calls0 = g_calls, bytes0 = g_bytes;
+    auto t0 = Clock::now();
+    auto root = std::make_unique<CommandNode>(CommandPtr{});
+    for (int b = 0; b < kBlocks; ++b) {
+      auto block = std::make_unique<CommandNode>(makeCommand<HyIfCommand>());
+      for (int m = 0; m < kMovesPerBlock; ++m) {
+        block->appendChild(std::make_unique<CommandNode>(makeCommand<HyMoveLCommand>()));
+      }
+      root->appendChild(std::move(block));
+    }
+    const double build = msSince(t0);
+    const std::size_t calls = g_calls - calls0;
+    const double mb = double(g_bytes - bytes0) / (1024.0 * 1024.0);
+
+    t0 = Clock::now();
+    root.reset();
+    const double release = msSince(t0);
+
+    std::printf("%6d %10.1f %12zu %10.1f %10.1f\n", pass, build, calls, mb, release);
+  }
+  return 0;
+}
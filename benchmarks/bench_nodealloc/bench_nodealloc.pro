@@ -0,0 +1,14 @@
+QT -= gui
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_nodealloc
+INCLUDEPATH += ../.. ../../widget
+
+SOURCES += \
+    bench_nodealloc.cpp \
+    ../../widget/childsource.cpp \
+    ../../widget/command.cpp \
+    ../../widget/nametable.cpp \
+    ../../widget/slabpool.cpp
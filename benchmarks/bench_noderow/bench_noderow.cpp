@@ -0,0 +1,79 @@
+// CommandNode::row() as the sibling count grows. CommandModel::parent()
+// costs one row() call on the parent node, so this is the per-call cost of
+// parent() for rows of a wide block.
+//
+// Columns:
+//   row()      random lookups on a clean parent
+//   after edit the same lookups right after inserting a row at the front,
+//              which leaves every sibling stale (the first lookup renumbers)
+//   scan       the former implementation: linear search among the siblings
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "commandnode.h"
+
+using namespace rp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int kProbes = 100000;
+constexpr int kScanProbes = 200;
+
+volatile long long g_sink = 0;
+
+std::unique_ptr<CommandNode> makeNode() {
+  return std::make_unique<CommandNode>(makePooled<BaseCommand>());
+}
+
+template <class F>
+double nsPerCall(const std::vector<CommandNode*>& probes, F f) {
+  long long sink = 0;
+  const auto t0 = Clock::now();
+  for (CommandNode* p : probes) sink += f(p);
+  const auto t1 = Clock::now();
+  g_sink += sink;
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / probes.size();
+}
+
+// the lookup row() replaced
+int scanRow(const CommandNode* n) {
+  const CommandNode* parent = n->parent();
+  for (int i = 0; i < parent->childCount(); ++i) {
+    if (parent->child(i) == n) return i;
+  }
+  return -1;
+}
+
+}
+
+int main() {
+  std::printf("%10s %12s %12s %12s   (ns per call)\n", "siblings", "row()", "after edit", "scan");
+  for (int n : {1000, 10000, 100000, 1000000}) {
+    CommandNode root{CommandPtr{}};
+    std::vector<std::unique_ptr<CommandNode>> nodes;
+    nodes.reserve(n);
+    for (int i = 0; i < n; ++i) nodes.push_back(makeNode());
+    root.insertChildren(0, std::move(nodes));
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    std::vector<CommandNode*> probes(kProbes);
+    for (CommandNode*& p : probes) p = root.child(pick(rng));
+    const std::vector<CommandNode*> scanProbes(probes.begin(), probes.begin() + kScanProbes);
+
+    auto row = [](CommandNode* p) { return p->row(); };
+    nsPerCall(probes, row); // renumber once, warm caches
+    const double clean = nsPerCall(probes, row);
+
+    root.insertChild(0, makeNode());
+    const double afterEdit = nsPerCall(probes, row);
+
+    const double scan = nsPerCall(scanProbes, scanRow);
+
+    std::printf("%10d %12.1f %12.1f %12.1f\n", n, clean, afterEdit, scan);
+  }
+  return g_sink == 42 ? 1 : 0;
+}
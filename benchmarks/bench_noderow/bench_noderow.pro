@@ -0,0 +1,14 @@
+QT -= gui
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_noderow
+INCLUDEPATH += ../../widget
+
+SOURCES += \
+    bench_noderow.cpp \
+    ../../widget/childsource.cpp \
+    ../../widget/command.cpp \
+    ../../widget/nametable.cpp \
+    ../../widget/slabpool.cpp
@@ -0,0 +1,93 @@
+// Binary program format (ProgramFile) at 10k, 100k and 1M commands: If
+// blocks of 99 MoveL each.
+//
+// Columns:
+//   save       ProgramFile::save() of a fully materialized model
+//   open       ProgramFile::load() plus CommandModel::resetProgram(), i.e.
+//              until the first rows can be shown
+//   first 256  fetching the first batch of top-level rows
+//   fetch all  materializing every remaining row
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <cstdio>
+#include "commandmodel.h"
+#include "hyprgcommand.h"
+#include "programfile.h"
+
+using namespace rp;
+
+namespace {
+
+constexpr int kMovesPerBlock = 99;
+
+void buildProgram(CommandModel& model, int commands) {
+  const int blocks = commands / (kMovesPerBlock + 1);
+  std::vector<CommandPtr> ifs;
+  ifs.reserve(blocks);
+  for (int b = 0; b < blocks; ++b) ifs.push_back(makePooled<HyIfCommand>());
+  model.insertCommands(QModelIndex(), -1, ifs);
+
+  for (int b = 0; b < blocks; ++b) {
+    std::vector<CommandPtr> moves;
+    moves.reserve(kMovesPerBlock);
+    for (int m = 0; m < kMovesPerBlock; ++m) {
+      auto move = makePooled<HyMoveLCommand>();
+      move->setParam(0, b);
+      move->setParam(1, m);
+      move->setParam(3, 100 + m);
+      moves.push_back(std::move(move));
+    }
+    model.insertCommands(model.findIndexByCommand(ifs[b].get()), -1, moves);
+  }
+  model.history().clear();
+}
+
+double ms(const QElapsedTimer& t) {
+  return t.nsecsElapsed() / 1e6;
+}
+
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  CommandRegistry::registerCommand("MoveL", []{ return makePooled<HyMoveLCommand>(); });
+  CommandRegistry::registerCommand("If", []{ return makePooled<HyIfCommand>(); });
+
+  QTemporaryDir dir;
+  std::printf("%9s %9s %9s %9s %10s %10s\n",
+              "commands", "MB", "save ms", "open ms", "first 256", "fetch all");
+  for (int commands : {10000, 100000, 1000000}) {
+    const QString path = dir.filePath(QStringLiteral("bench.rprg"));
+    double saveMs = 0;
+    {
+      CommandModel source;
+      buildProgram(source, commands);
+      QElapsedTimer t;
+      t.start();
+      if (!ProgramFile::save(&source, path)) return 1;
+      saveMs = ms(t);
+    }
+
+    CommandModel model;
+    QElapsedTimer t;
+    t.start();
+    auto program = ProgramFile::load(path);
+    if (!program) return 1;
+    model.resetProgram(std::move(program));
+    const double openMs = ms(t);
+
+    t.restart();
+    model.fetchMore(QModelIndex());
+    const double firstMs = ms(t);
+
+    t.restart();
+    model.fetchAll(QModelIndex(), /*recursive=*/true);
+    const double allMs = ms(t);
+
+    std::printf("%9d %9.1f %9.1f %9.3f %10.2f %10.1f\n", commands,
+                QFileInfo(path).size() / (1024.0 * 1024.0), saveMs, openMs, firstMs, allMs);
+  }
+  return 0;
+}
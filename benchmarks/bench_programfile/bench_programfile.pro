@@ -0,0 +1,11 @@
+QT += widgets
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_programfile
+
+SOURCES += \
+    bench_programfile.cpp
+
+include(../../widget/widget.pri)
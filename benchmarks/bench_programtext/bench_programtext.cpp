@@ -0,0 +1,99 @@
+// Text program format (ProgramText) on a generated file of about 200 MB
+// (pass another size in MB as the first argument): If blocks of 99 MoveL
+// each, written line by line so generating it costs no memory.
+//
+// Columns:
+//   MB         file size
+//   import     ProgramText::read() into an empty model: ms and MB/s
+//   peak MB    peak resident memory of the process after the import
+//   held MB    resident memory the imported program keeps (staged commands,
+//              no nodes yet), over the empty model
+//   export     ProgramText::write() of the imported program once all of its
+//              rows are fetched: MB/s
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <cstdio>
+#include <cstdlib>
+#include "commandmodel.h"
+#include "hyprgcommand.h"
+#include "memoryprobe.h"
+#include "programtext.h"
+
+using namespace rp;
+
+namespace {
+
+constexpr int kMovesPerBlock = 99;
+
+bool generate(const QString& path, qint64 bytes) {
+  QFile f(path);
+  if (!f.open(QIODevice::WriteOnly)) return false;
+  QByteArray buf = "{\"format\":\"rprg-text\",\"version\":1}\n";
+  qint64 written = 0;
+  for (int b = 0; written + buf.size() < bytes; ++b) {
+    buf += "{\"depth\":0,\"type\":\"If\"}\n";
+    for (int m = 0; m < kMovesPerBlock; ++m) {
+      char line[160];
+      const int n = std::snprintf(line, sizeof(line),
+                                  "{\"depth\":1,\"params\":{\"speed\":%d,\"x\":%d.5,\"y\":%d,\"z\":%d},"
+                                  "\"type\":\"MoveL\"}\n", 100 + m, b % 1000, m, 200 + m % 7);
+      buf.append(line, n);
+    }
+    if (buf.size() >= 1024 * 1024) {
+      if (f.write(buf) != buf.size()) return false;
+      written += buf.size();
+      buf.clear();
+    }
+  }
+  return f.write(buf) == buf.size();
+}
+
+double ms(const QElapsedTimer& t) {
+  return t.nsecsElapsed() / 1e6;
+}
+
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  CommandRegistry::registerCommand("MoveL", []{ return makePooled<HyMoveLCommand>(); });
+  CommandRegistry::registerCommand("If", []{ return makePooled<HyIfCommand>(); });
+  const qint64 targetMB = argc > 1 ? std::atoll(argv[1]) : 200;
+
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("bench.jsonl"));
+  if (!generate(path, targetMB * 1024 * 1024)) return 1;
+  const double fileMB = QFile(path).size() / (1024.0 * 1024.0);
+
+  CommandModel model;
+  const double before = bench::residentMB();
+  QFile in(path);
+  if (!in.open(QIODevice::ReadOnly)) return 1;
+  QElapsedTimer t;
+  t.start();
+  QString error;
+  if (!ProgramText::read(&model, &in, &error)) {
+    std::fprintf(stderr, "%s\n", qPrintable(error));
+    return 1;
+  }
+  const double importMs = ms(t);
+  const double peak = bench::peakResidentMB();
+  const double held = bench::residentMB() - before;
+
+  model.fetchAll(QModelIndex(), /*recursive=*/true);
+  QFile out(dir.filePath(QStringLiteral("out.jsonl")));
+  if (!out.open(QIODevice::WriteOnly)) return 1;
+  t.restart();
+  if (!ProgramText::write(&model, &out)) return 1;
+  out.close();
+  const double exportMB = out.size() / (1024.0 * 1024.0);
+  const double exportMs = ms(t);
+
+  std::printf("%8s %10s %10s %9s %9s %10s\n",
+              "MB", "import ms", "import MB/s", "peak MB", "held MB", "export MB/s");
+  std::printf("%8.1f %10.0f %10.1f %9.1f %9.1f %10.1f\n", fileMB, importMs,
+              fileMB / (importMs / 1000.0), peak, held, exportMB / (exportMs / 1000.0));
+  return 0;
+}
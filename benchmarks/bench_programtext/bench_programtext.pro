@@ -0,0 +1,13 @@
+QT += widgets
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_programtext
+INCLUDEPATH += ..
+win32: LIBS += -lpsapi
+
+SOURCES += \
+    bench_programtext.cpp
+
+include(../../widget/widget.pri)
@@ -0,0 +1,150 @@
+// CommandTreeView with 1k, 10k and 100k top-level MoveL rows. Run on a real
+// display or with QT_QPA_PLATFORM=offscreen; the view is 800x600.
+//
+// Modes:
+//   editors    the baseline: one persistent CommandRowWidget editor per row
+//              (openPersistentEditor), as the view did before RowDelegate
+//              painted rows; at 100k rows this takes a while
+//   painted    RowDelegate paints every row, no widget per row
+//   pooled     CommandTreeView::setRowWidgets(true): widgets for the rows in
+//              the viewport only, recycled while scrolling
+//
+// Columns:
+//   QObjects   objects under the view once it is shown (widgets, layouts,
+//              delegates); the model's rows are not QObjects
+//   view MB    resident memory added by opening the editors, showing the
+//              view and scrolling it through the whole program, on top of
+//              the filled model (see memoryprobe.h; approximate)
+//   frame ms   one scroll step of half a page: scroll bar update, queued
+//              row layout and a synchronous viewport repaint; mean and 95th
+//              percentile over kFrames steps
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QScrollBar>
+#include <QStyledItemDelegate>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "commandrowwidget.h"
+#include "commandtreeview.h"
+#include "hyprgcommand.h"
+#include "memoryprobe.h"
+
+using namespace rp;
+
+namespace {
+
+constexpr int kFrames = 300;
+
+enum class Mode { Editors, Painted, Pooled };
+
+const char* modeName(Mode mode) {
+  switch (mode) {
+  case Mode::Editors: return "editors";
+  case Mode::Painted: return "painted";
+  case Mode::Pooled: return "pooled";
+  }
+  return "";
+}
+
+// The delegate of the baseline: a CommandRowWidget editor per row, kept
+// open for the lifetime of the row.
+class EditorRowDelegate : public QStyledItemDelegate {
+public:
+  using QStyledItemDelegate::QStyledItemDelegate;
+
+  QWidget* createEditor(QWidget* parent, const QStyleOptionViewItem&,
+                        const QModelIndex&) const override {
+    return new CommandRowWidget(parent);
+  }
+
+  void setEditorData(QWidget* editor, const QModelIndex& index) const override {
+    auto* m = const_cast<CommandModel*>(static_cast<const CommandModel*>(index.model()));
+    static_cast<CommandRowWidget*>(editor)->setContext(index, m);
+  }
+
+  void updateEditorGeometry(QWidget* editor, const QStyleOptionViewItem& option,
+                            const QModelIndex&) const override {
+    editor->setGeometry(option.rect);
+  }
+
+  QSize sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const override {
+    return QSize(0, 36);
+  }
+};
+
+void settle() {
+  // row widgets are laid out from a queued call
+  for (int i = 0; i < 3; ++i) QCoreApplication::processEvents();
+}
+
+void run(int rows, Mode mode) {
+  CommandTreeView view;
+  view.setRowWidgets(mode == Mode::Pooled);
+  if (mode == Mode::Editors) view.setItemDelegate(new EditorRowDelegate(&view));
+  view.resize(800, 600);
+
+  std::vector<CommandPtr> moves;
+  moves.reserve(rows);
+  for (int i = 0; i < rows; ++i) {
+    auto move = makePooled<HyMoveLCommand>();
+    move->setParam(0, i);
+    move->setParam(3, 100);
+    moves.push_back(std::move(move));
+  }
+  view.model()->insertCommands(QModelIndex(), -1, moves);
+  view.model()->history().clear();
+  moves.clear();
+  settle();
+
+  const double before = bench::residentMB();
+  if (mode == Mode::Editors) {
+    CommandModel* model = view.model();
+    for (int r = 0; r < model->rowCount(QModelIndex()); ++r) {
+      view.openPersistentEditor(model->index(r, 0, QModelIndex()));
+    }
+  }
+  view.show();
+  settle();
+  const int objects = view.findChildren<QObject*>().size();
+
+  QScrollBar* bar = view.verticalScrollBar();
+  const int step = std::max(1, bar->pageStep() / 2);
+  std::vector<double> frames;
+  frames.reserve(kFrames);
+  for (int f = 0; f < kFrames; ++f) {
+    QElapsedTimer t;
+    t.start();
+    bar->setValue(bar->value() + step >= bar->maximum() ? 0 : bar->value() + step);
+    QCoreApplication::processEvents();
+    view.viewport()->repaint();
+    frames.push_back(t.nsecsElapsed() / 1e6);
+  }
+  // visit every row once so bound widgets and cached titles are counted
+  for (int v = 0; v <= bar->maximum(); v += bar->pageStep()) {
+    bar->setValue(v);
+    QCoreApplication::processEvents();
+  }
+  const double after = bench::residentMB();
+
+  double mean = 0;
+  for (double f : frames) mean += f;
+  mean /= frames.size();
+  std::sort(frames.begin(), frames.end());
+  const double p95 = frames[frames.size() * 95 / 100];
+
+  std::printf("%8d %9s %9d %9.1f %9.2f %9.2f\n", rows, modeName(mode),
+              objects, before < 0 ? -1.0 : after - before, mean, p95);
+}
+
+}
+
+int main(int argc, char** argv) {
+  QApplication app(argc, argv);
+  std::printf("%8s %9s %9s %9s %9s %9s\n", "rows", "mode", "QObjects", "view MB",
+              "frame ms", "p95 ms");
+  for (int rows : {1000, 10000, 100000}) {
+    for (Mode mode : {Mode::Editors, Mode::Painted, Mode::Pooled}) run(rows, mode);
+  }
+  return 0;
+}
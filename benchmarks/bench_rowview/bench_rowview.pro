@@ -0,0 +1,13 @@
+QT += widgets
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = bench_rowview
+INCLUDEPATH += ..
+win32: LIBS += -lpsapi
+
+SOURCES += \
+    bench_rowview.cpp
+
+include(../../widget/widget.pri)
@@ -0,0 +1,95 @@
+// CommandSearchIndex::find() over 500k commands: If blocks of 99 MoveL each,
+// MoveL i of block b at P=(b,i,0) with v=100+i.
+//
+// Columns:
+//   matches  rows found once everything is fetched
+//   pending  find() while every row is still pending in its ChildSource
+//   rows     find() after fetchAll(), every row a node
+// Times are ms, best of kRepeats, with the index already built.
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <cstdio>
+#include "childsource.h"
+#include "commandmodel.h"
+#include "commandsearchindex.h"
+#include "hyprgcommand.h"
+
+using namespace rp;
+
+namespace {
+
+constexpr int kBlocks = 5000;
+constexpr int kMovesPerBlock = 99;
+constexpr int kRepeats = 10;
+
+std::unique_ptr<ChildSource> buildProgram() {
+  auto top = std::make_unique<CommandListSource>();
+  for (int b = 0; b < kBlocks; ++b) {
+    auto moves = std::make_unique<CommandListSource>();
+    for (int m = 0; m < kMovesPerBlock; ++m) {
+      auto move = makePooled<HyMoveLCommand>();
+      move->setParam(0, b);
+      move->setParam(1, m);
+      move->setParam(3, 100 + m);
+      moves->append(std::move(move));
+    }
+    top->append(makePooled<HyIfCommand>(), std::move(moves));
+  }
+  return top;
+}
+
+double ms(const QElapsedTimer& t) {
+  return t.nsecsElapsed() / 1e6;
+}
+
+double bestFindMs(const CommandSearchIndex& index, const QString& query) {
+  double best = 1e300;
+  std::vector<CommandSearchIndex::PendingMatch> pending;
+  for (int r = 0; r < kRepeats; ++r) {
+    QElapsedTimer t;
+    t.start();
+    index.find(query, &pending);
+    best = std::min(best, ms(t));
+  }
+  return best;
+}
+
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  const QString queries[] = {
+    QStringLiteral("p=(1234,17,"), // one row
+    QStringLiteral("v=150"),       // one row per block
+    QStringLiteral("if this"),     // every block
+    QStringLiteral("movel"),       // nearly every row
+    QStringLiteral("movel v=1"),   // same rows, two terms
+    QStringLiteral(",1"),          // short term: scan
+    QStringLiteral("zzz"),         // no row
+  };
+
+  CommandModel model;
+  model.resetProgram(buildProgram());
+  CommandSearchIndex index(&model);
+
+  QElapsedTimer t;
+  t.start();
+  index.find(QStringLiteral("zzz"));
+  const double build = ms(t);
+  std::vector<double> pendingMs;
+  for (const QString& q : queries) pendingMs.push_back(bestFindMs(index, q));
+
+  model.fetchAll(QModelIndex(), /*recursive=*/true); // the index follows the fetches
+
+  std::printf("%d rows indexed, first find() %.1f ms (builds the index)\n",
+              index.size(), build);
+  std::printf("%14s %9s %9s %9s   (ms, best of %d)\n", "query", "matches", "pending", "rows", kRepeats);
+  for (std::size_t i = 0; i < std::size(queries); ++i) {
+    const QString& q = queries[i];
+    const std::size_t matches = index.find(q).size();
+    std::printf("%14s %9zu %9.2f %9.2f\n", qPrintable(q), matches, pendingMs[i],
+                bestFindMs(index, q));
+  }
+  return 0;
+}
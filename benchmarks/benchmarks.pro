@@ -0,0 +1,14 @@
+# Stand-alone benchmarks, built separately from the application:
+#   qmake benchmarks/benchmarks.pro && make
+# Each one prints a table to stdout; build in release mode.
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    bench_movelkernels \
+    bench_nodealloc \
+    bench_nodeaggregate \
+    bench_noderow \
+    bench_programfile \
+    bench_programtext \
+    bench_searchindex \
+    bench_rowview
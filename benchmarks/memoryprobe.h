@@ -0,0 +1,71 @@
+#ifndef MEMORYPROBE_H
+#define MEMORYPROBE_H
+
+// Resident memory of the benchmark process, for the benchmarks' memory
+// columns. Both functions return MB, or -1 where the platform gives no
+// answer. Allocator reuse makes differences of residentMB() approximate.
+
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#  include <psapi.h>
+#elif defined(__APPLE__)
+#  include <mach/mach.h>
+#else
+#  include <cstdio>
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+namespace bench {
+
+inline double residentMB() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+  return double(pmc.WorkingSetSize) / (1024.0 * 1024.0);
+#elif defined(__APPLE__)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return -1;
+  }
+  return double(info.resident_size) / (1024.0 * 1024.0);
+#else
+  // second field of statm: resident pages
+  std::FILE* f = std::fopen("/proc/self/statm", "r");
+  if (!f) return -1;
+  long size = 0, resident = 0;
+  const bool ok = std::fscanf(f, "%ld %ld", &size, &resident) == 2;
+  std::fclose(f);
+  return ok ? double(resident) * double(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0) : -1;
+#endif
+}
+
+// High-water mark of residentMB() since the process started.
+inline double peakResidentMB() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+  return double(pmc.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#elif defined(__APPLE__)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return -1;
+  }
+  return double(info.resident_size_max) / (1024.0 * 1024.0);
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+  return double(usage.ru_maxrss) / 1024.0; // kilobytes here
+#endif
+}
+
+}
+
+#endif // MEMORYPROBE_H
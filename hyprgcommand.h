@@ -21,12 +21,16 @@ public:
   }
 
   Type type() const override {
-    return Type::Start;
+    return Type::If;
   }
 
   const bool isAllowChild() const override {
     return true;
   }
+
+  std::shared_ptr<Command> clone() const override {
+    return makePooled<HyIfCommand>(*this);
+  }
 };
 
 class HyMoveLCommand final : public BaseCommand {
@@ -52,6 +56,44 @@ public:
     return false;
   }
 
+  std::shared_ptr<Command> clone() const override {
+    return makePooled<HyMoveLCommand>(*this);
+  }
+
+  int paramCount() const override {
+    return 4;
+  }
+
+  QString paramName(int i) const override {
+    switch (i) {
+    case 0: return QStringLiteral("x");
+    case 1: return QStringLiteral("y");
+    case 2: return QStringLiteral("z");
+    case 3: return QStringLiteral("speed");
+    default: return QString::number(i);
+    }
+  }
+
+  double param(int i) const override {
+    switch (i) {
+    case 0: return x;
+    case 1: return y;
+    case 2: return z;
+    case 3: return speed;
+    default: return 0.0;
+    }
+  }
+
+  void setParam(int i, double value) override {
+    switch (i) {
+    case 0: x = value; break;
+    case 1: y = value; break;
+    case 2: z = value; break;
+    case 3: speed = value; break;
+    default: break;
+    }
+  }
+
 public:
     double x{0}, y{0}, z{0};
     double speed{100};
@@ -7,6 +7,23 @@
 #include "widget/commandeditor.h"
 #include "moveleditor.h"
 
+#include "widget/executionengine.h"
+#include "widget/programfile.h"
+#include "widget/programloader.h"
+#include "widget/programtext.h"
+#include "widget/programvalidator.h"
+
+#include <QAction>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QLineEdit>
+#include <QMenu>
+#include <QMenuBar>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QSaveFile>
+#include <QToolBar>
+
 MainWindow::MainWindow(
     QWidget *parent)
     : QMainWindow(parent)
@@ -14,14 +31,73 @@ MainWindow::MainWindow(
 {
   ui->setupUi(this);
 
-  ui->treeView->registerCommandType("MoveL", []{ return std::make_shared<rp::HyMoveLCommand>(); });
-  ui->treeView->registerCommandType("If",    []{ return std::make_shared<rp::HyIfCommand>(); });
+  ui->treeView->registerCommandType("MoveL", []{ return rp::makePooled<rp::HyMoveLCommand>(); });
+  ui->treeView->registerCommandType("If",    []{ return rp::makePooled<rp::HyIfCommand>(); });
 
   rp::EditorRegistry::registerEditor("MoveL", [](QWidget* p){ return new rp::MoveLEditor(p); });
 
   connect(ui->treeView, &rp::CommandTreeView::commandClicked,
           this, &MainWindow::CommandClicked);
 
+  rp::CommandModel* model = ui->treeView->model();
+  m_loader = new rp::ProgramLoader(model, this);
+
+  // File menu: binary program files (see rp::ProgramFile)
+  QMenu* fileMenu = ui->menubar->addMenu(tr("&File"));
+  QAction* openAct = fileMenu->addAction(tr("&Open..."), this, &MainWindow::openProgram);
+  QAction* saveAct = fileMenu->addAction(tr("&Save As..."), this, &MainWindow::saveProgram);
+  openAct->setShortcut(QKeySequence::Open);
+  saveAct->setShortcut(QKeySequence::SaveAs);
+
+  // Run menu: dry run of the program (see rp::ExecutionEngine)
+  m_engine = new rp::ExecutionEngine(model, this);
+  QMenu* runMenu = ui->menubar->addMenu(tr("&Run"));
+  QAction* runAct = runMenu->addAction(tr("&Run"), m_engine, &rp::ExecutionEngine::run);
+  QAction* stepAct = runMenu->addAction(tr("&Step"), m_engine, &rp::ExecutionEngine::step);
+  QAction* pauseAct = runMenu->addAction(tr("&Pause"), m_engine, &rp::ExecutionEngine::pause);
+  QAction* stopAct = runMenu->addAction(tr("S&top"), m_engine, &rp::ExecutionEngine::stop);
+  runAct->setShortcut(Qt::Key_F5);
+  stepAct->setShortcut(Qt::Key_F10);
+  stopAct->setShortcut(Qt::SHIFT | Qt::Key_F5);
+  auto syncRun = [this, runAct, pauseAct, stopAct]{
+    const auto s = m_engine->state();
+    runAct->setEnabled(s != rp::ExecutionEngine::State::Running);
+    pauseAct->setEnabled(s == rp::ExecutionEngine::State::Running);
+    stopAct->setEnabled(s != rp::ExecutionEngine::State::Idle);
+  };
+  connect(m_engine, &rp::ExecutionEngine::stateChanged, this, syncRun);
+  connect(m_engine, &rp::ExecutionEngine::currentCommandChanged,
+          ui->treeView, &rp::CommandTreeView::setActiveCommand);
+  syncRun();
+
+  // search box filtering the tree (see rp::CommandSearchIndex)
+  QToolBar* searchBar = addToolBar(tr("Search"));
+  auto* search = new QLineEdit(searchBar);
+  search->setPlaceholderText(tr("Search commands"));
+  search->setClearButtonEnabled(true);
+  searchBar->addWidget(search);
+  connect(search, &QLineEdit::textChanged, ui->treeView, &rp::CommandTreeView::setFilterText);
+  QAction* findAct = new QAction(tr("&Find"), this);
+  findAct->setShortcut(QKeySequence::Find);
+  connect(findAct, &QAction::triggered, search, [search]{ search->setFocus(); search->selectAll(); });
+  addAction(findAct);
+
+  // background checks, findings show up on the rows
+  new rp::ProgramValidator(model, this);
+
+  // Edit menu: undo/redo over the model history
+  QMenu* editMenu = ui->menubar->addMenu(tr("&Edit"));
+  QAction* undoAct = editMenu->addAction(tr("&Undo"), model, &rp::CommandModel::undo);
+  QAction* redoAct = editMenu->addAction(tr("&Redo"), model, &rp::CommandModel::redo);
+  undoAct->setShortcut(QKeySequence::Undo);
+  redoAct->setShortcut(QKeySequence::Redo);
+  auto syncHistory = [model, undoAct, redoAct]{
+    undoAct->setEnabled(model->canUndo());
+    redoAct->setEnabled(model->canRedo());
+  };
+  connect(model, &rp::CommandModel::historyChanged, this, syncHistory);
+  syncHistory();
+
   // connect(ui->treeView, &rp::CommandTreeView::commandClicked,
   //         ui->stackedWidget, [this, ui->stackedWidget, model=ui->treeView->model()](rp::Command* c){
   //           panel->editCommand(model, c);
@@ -47,6 +123,60 @@ MainWindow::~MainWindow()
 }
 
 
+// *.rprg: binary image (rp::ProgramFile), *.jsonl: text (rp::ProgramText)
+static const char* kProgramFilters = QT_TRANSLATE_NOOP("MainWindow",
+    "Robot program (*.rprg);;Robot program text (*.jsonl)");
+
+void MainWindow::openProgram() {
+  if (m_loader->isRunning()) {
+    return;
+  }
+  const QString path = QFileDialog::getOpenFileName(this, tr("Open program"), QString(),
+                                                    tr(kProgramFilters));
+  if (path.isEmpty()) {
+    return;
+  }
+
+  // text programs are parsed on a worker thread, keep the window responsive
+  auto* dlg = new QProgressDialog(tr("Loading %1").arg(QFileInfo(path).fileName()),
+                                  tr("Cancel"), 0, 100, this);
+  dlg->setAttribute(Qt::WA_DeleteOnClose);
+  dlg->setMinimumDuration(500);
+  connect(dlg, &QProgressDialog::canceled, m_loader, &rp::ProgramLoader::cancel);
+  connect(m_loader, &rp::ProgramLoader::progress, dlg, [dlg](qint64 done, qint64 total){
+    if (total > 0) dlg->setValue(int(done * 100 / total));
+  });
+  connect(m_loader, &rp::ProgramLoader::finished, dlg, [this, dlg](bool ok, const QString& error){
+    dlg->close();
+    if (!ok && !dlg->wasCanceled()) {
+      QMessageBox::warning(this, tr("Open program"), error);
+    }
+  });
+  m_loader->start(path);
+}
+
+void MainWindow::saveProgram() {
+  const QString path = QFileDialog::getSaveFileName(this, tr("Save program"), QString(),
+                                                    tr(kProgramFilters));
+  if (path.isEmpty()) {
+    return;
+  }
+  QString error;
+  if (path.endsWith(QStringLiteral(".jsonl"), Qt::CaseInsensitive)) {
+    QSaveFile f(path);
+    bool ok = f.open(QIODevice::WriteOnly) // LF on every platform
+              && rp::ProgramText::write(ui->treeView->model(), &f, &error);
+    ok = ok && f.commit();
+    if (!ok) {
+      QMessageBox::warning(this, tr("Save program"), error.isEmpty() ? f.errorString() : error);
+    }
+    return;
+  }
+  if (!rp::ProgramFile::save(ui->treeView->model(), path, &error)) {
+    QMessageBox::warning(this, tr("Save program"), error);
+  }
+}
+
 void MainWindow::CommandClicked(rp::Command* cmd) {
   ui->stackedWidget->editCommand(ui->treeView->model(), cmd);
 }
@@ -4,6 +4,8 @@
 #include <QMainWindow>
 #include "widget/command.h"
 
+namespace rp { class ExecutionEngine; class ProgramLoader; }
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -18,8 +20,12 @@ public:
 
 private:
   void CommandClicked(rp::Command* cmd);
+  void openProgram();
+  void saveProgram();
 
 private:
   Ui::MainWindow *ui;
+  rp::ProgramLoader* m_loader {nullptr};
+  rp::ExecutionEngine* m_engine {nullptr};
 };
 #endif // MAINWINDOW_H
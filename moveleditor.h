@@ -5,6 +5,7 @@
 #include "widget/commandeditor.h"
 #include <QDoubleSpinBox>
 #include <QFormLayout>
+#include <QSignalBlocker>
 
 namespace rp {
 class MoveLEditor : public CommandEditorWidget {
@@ -27,25 +28,36 @@ public:
   }
 
   void setContext(CommandModel* model, Command* cmd) override {
+    if (m) disconnect(m, nullptr, this, nullptr);
     m = model; c = dynamic_cast<HyMoveLCommand*>(cmd);
     if (!c) { setEnabled(false); return; }
     setEnabled(true);
-    sx->setValue(c->x); sy->setValue(c->y); sz->setValue(c->z); sv->setValue(c->speed);
+    load();
+
+    // undo/redo đổi tham số từ bên ngoài -> đồng bộ lại spinbox
+    if (m) connect(m, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft) {
+      if (c && m->commandFromIndex(topLeft) == c) load();
+    });
   }
 
 private slots:
   void apply() {
     if (!m || !c) return;
-    // (khuyến nghị) dùng QUndoStack; ở đây minh họa direct apply
-    c->x = sx->value(); c->y = sy->value(); c->z = sz->value(); c->speed = sv->value();
-
-    // Báo model để các row refresh
-    if (auto idx = m->findIndexByCommand(c); idx.isValid())
-      emit m->dataChanged(idx, idx, {Qt::DisplayRole}); // hoặc dùng refreshAllRows ở view
+    // Đi qua model để thay đổi được ghi vào lịch sử undo (model tự phát dataChanged)
+    const double x = sx->value(), y = sy->value(), z = sz->value(), v = sv->value();
+    m->editCommand(c, [&](Command*) {
+      c->x = x; c->y = y; c->z = z; c->speed = v;
+    });
 
     emit parametersChanged(c);
   }
 
+private:
+  void load() {
+    QSignalBlocker bx(sx), by(sy), bz(sz), bv(sv);
+    sx->setValue(c->x); sy->setValue(c->y); sz->setValue(c->z); sv->setValue(c->speed);
+  }
+
 private:
   CommandModel* m{nullptr};
   HyMoveLCommand* c{nullptr};
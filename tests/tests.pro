@@ -0,0 +1,7 @@
+# Unit tests, built separately from the application:
+#   qmake tests/tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    tst_programcompiler \
+    tst_rowactions
@@ -0,0 +1,243 @@
+#include <QBuffer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "commandmodel.h"
+#include "commandsearchindex.h"
+#include "hyprgcommand.h"
+#include "programcompiler.h"
+#include "programfile.h"
+#include "programtext.h"
+#include <cstring>
+
+using namespace rp;
+
+class TestProgramCompiler : public QObject {
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void compilesPendingRowsOfBinaryFile();
+  void compilesPendingRowsOfTextFile();
+  void editAfterLoadIsCompiled();
+  void pendingRowsKeepOrderAndTotals();
+  void rejectsCorruptRecords();
+  void searchFindsPendingRows();
+
+private:
+  // `blocks` If blocks of `moves` MoveL each, then `moves` top-level MoveL;
+  // far more rows than one fetch batch
+  static void buildProgram(CommandModel& model, int blocks, int moves);
+  static void verifyComplete(ProgramCompiler& compiler, int blocks, int moves);
+};
+
+void TestProgramCompiler::initTestCase() {
+  CommandRegistry::registerCommand("MoveL", []{ return makePooled<HyMoveLCommand>(); });
+  CommandRegistry::registerCommand("If", []{ return makePooled<HyIfCommand>(); });
+}
+
+void TestProgramCompiler::buildProgram(CommandModel& model, int blocks, int moves) {
+  std::vector<CommandPtr> ifs;
+  for (int b = 0; b < blocks; ++b) ifs.push_back(makePooled<HyIfCommand>());
+  QVERIFY(model.insertCommands(QModelIndex(), -1, ifs));
+  for (const CommandPtr& block : ifs) {
+    std::vector<CommandPtr> body;
+    for (int m = 0; m < moves; ++m) body.push_back(makePooled<HyMoveLCommand>());
+    QVERIFY(model.insertCommands(model.findIndexByCommand(block.get()), -1, body));
+  }
+  std::vector<CommandPtr> tail;
+  for (int m = 0; m < moves; ++m) tail.push_back(makePooled<HyMoveLCommand>());
+  QVERIFY(model.insertCommands(QModelIndex(), -1, tail));
+}
+
+void TestProgramCompiler::verifyComplete(ProgramCompiler& compiler, int blocks, int moves) {
+  const BytecodePtr bc = compiler.program();
+  QVERIFY(bc);
+  // Start, every row, End
+  const int rows = blocks * (moves + 1) + moves;
+  QCOMPARE(int(bc->code.size()), 1 + rows + 1);
+  QCOMPARE(int(bc->motions.size()), (blocks + 1) * moves);
+
+  int ifs = 0;
+  for (const Instruction& ins : bc->code) {
+    if (ins.op != OpCode::JumpIfNot) continue;
+    QCOMPARE(ins.arg, moves); // body compiled although never expanded
+    ++ifs;
+  }
+  QCOMPARE(ifs, blocks);
+  QCOMPARE(bc->code.back().op, OpCode::End);
+}
+
+void TestProgramCompiler::compilesPendingRowsOfBinaryFile() {
+  const int blocks = 300, moves = 20;
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("program.rprg"));
+  {
+    CommandModel source;
+    buildProgram(source, blocks, moves);
+    QVERIFY(ProgramFile::save(&source, path));
+  }
+
+  CommandModel model;
+  auto program = ProgramFile::load(path);
+  QVERIFY(program);
+  model.resetProgram(std::move(program));
+  model.fetchMore(QModelIndex()); // what a view does: one batch, nothing expanded
+  QVERIFY(model.hasPendingRows());
+
+  ProgramCompiler compiler(&model);
+  verifyComplete(compiler, blocks, moves);
+  QVERIFY(!model.hasPendingRows());
+}
+
+void TestProgramCompiler::compilesPendingRowsOfTextFile() {
+  const int blocks = 300, moves = 20;
+  QBuffer text;
+  QVERIFY(text.open(QIODevice::ReadWrite));
+  {
+    CommandModel source;
+    buildProgram(source, blocks, moves);
+    QVERIFY(ProgramText::write(&source, &text));
+  }
+  text.seek(0);
+
+  CommandModel model;
+  QString error;
+  QVERIFY2(ProgramText::read(&model, &text, &error), qPrintable(error));
+  QVERIFY(model.hasPendingRows());
+
+  ProgramCompiler compiler(&model);
+  verifyComplete(compiler, blocks, moves);
+}
+
+void TestProgramCompiler::editAfterLoadIsCompiled() {
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("program.rprg"));
+  {
+    CommandModel source;
+    buildProgram(source, 2, 3);
+    QVERIFY(ProgramFile::save(&source, path));
+  }
+  CommandModel model;
+  model.resetProgram(ProgramFile::load(path));
+  ProgramCompiler compiler(&model);
+  const BytecodePtr before = compiler.program();
+
+  // last MoveL of the first block
+  const QModelIndex block = model.index(1, 0, QModelIndex());
+  Command* move = model.commandFromIndex(model.index(2, 0, block));
+  QVERIFY(move);
+  QVERIFY(model.editCommand(move, [](Command* c) { c->setParam(3, 42.0); }));
+
+  BytecodePtr after = compiler.program();
+  QVERIFY(after != before);
+  QCOMPARE(after->code.size(), before->code.size());
+  const Instruction ins = after->code[1 + 1 + 2]; // Start, If, two MoveL
+  QCOMPARE(ins.op, OpCode::MoveL);
+  QCOMPARE(after->motions[ins.arg].speed, 42.0);
+  QVERIFY(before->motions[ins.arg].speed != 42.0); // handed-out image untouched
+
+  // nobody else holds the image: the next edit is patched into it
+  const Bytecode* image = after.get();
+  after.reset();
+  QVERIFY(model.editCommand(move, [](Command* c) { c->setParam(3, 7.0); }));
+  after = compiler.program();
+  QCOMPARE(after.get(), image);
+  QCOMPARE(after->motions[ins.arg].speed, 7.0);
+  QCOMPARE(after->dataRevision, model.dataRevision());
+}
+
+// Rows below collapsed blocks are still pending: row numbers, lookups by
+// position and block totals must already account for them.
+void TestProgramCompiler::pendingRowsKeepOrderAndTotals() {
+  const int blocks = 300, moves = 20;
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("program.rprg"));
+  {
+    CommandModel source;
+    buildProgram(source, blocks, moves);
+    QVERIFY(ProgramFile::save(&source, path));
+  }
+  CommandModel model;
+  model.resetProgram(ProgramFile::load(path));
+  model.fetchAll(QModelIndex()); // top level only, every block collapsed
+  QVERIFY(model.hasPendingRows());
+
+  const QModelIndex block = model.index(1, 0, QModelIndex());
+  QCOMPARE(model.rowCount(block), 0);
+  QVERIFY(model.canFetchMore(block));
+  QCOMPARE(model.data(block, CommandModel::MoveCountRole).toInt(), moves);
+  QCOMPARE(model.programAggregate().moveCount, (blocks + 1) * moves);
+
+  const QModelIndex firstTail = model.index(blocks + 1, 0, QModelIndex());
+  QCOMPARE(model.globalOrder(firstTail), blocks * (moves + 1));
+
+  // position inside a collapsed block: fetched on the way down
+  const int order = 5 * (moves + 1) + 1 + 7; // 8th MoveL of the 6th block
+  const QModelIndex found = model.indexAtGlobalOrder(order);
+  QVERIFY(found.isValid());
+  QCOMPARE(found.row(), 7);
+  QCOMPARE(found.parent(), model.index(6, 0, QModelIndex()));
+  QCOMPARE(model.globalOrder(found), order);
+  QCOMPARE(model.globalOrder(firstTail), blocks * (moves + 1));
+}
+
+// A broken record table fails in load(), before any row is fetched.
+void TestProgramCompiler::rejectsCorruptRecords() {
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("program.rprg"));
+  {
+    CommandModel source;
+    buildProgram(source, 2, 3);
+    QVERIFY(ProgramFile::save(&source, path));
+  }
+  QFile file(path);
+  QVERIFY(file.open(QIODevice::ReadWrite));
+  QByteArray bytes = file.readAll();
+  const qint32 tooLarge = 5; // first MoveL of the first block now reaches past it
+  std::memcpy(bytes.data() + 64 + 32 * 1 + 4, &tooLarge, sizeof(tooLarge));
+  file.seek(0);
+  QCOMPARE(file.write(bytes), bytes.size());
+  file.close();
+
+  QString error;
+  QVERIFY(!ProgramFile::load(path, &error));
+  QVERIFY(!error.isEmpty());
+}
+
+// Matches inside a collapsed block are found without fetching it, and
+// become rows once the block is fetched up to them.
+void TestProgramCompiler::searchFindsPendingRows() {
+  const int blocks = 300, moves = 20;
+  QTemporaryDir dir;
+  const QString path = dir.filePath(QStringLiteral("program.rprg"));
+  {
+    CommandModel source;
+    buildProgram(source, blocks, moves);
+    const QModelIndex move = source.index(7, 0, source.index(6, 0, QModelIndex()));
+    QVERIFY(source.editCommand(source.commandFromIndex(move),
+                               [](Command* c) { c->setParam(0, 4242); }));
+    QVERIFY(ProgramFile::save(&source, path));
+  }
+  CommandModel model;
+  model.resetProgram(ProgramFile::load(path));
+  model.fetchAll(QModelIndex()); // top level only, every block collapsed
+  CommandSearchIndex index(&model);
+
+  std::vector<CommandSearchIndex::PendingMatch> pending;
+  QVERIFY(index.find(QStringLiteral("P=(4242,"), &pending).empty());
+  const QModelIndex block = model.index(6, 0, QModelIndex());
+  QCOMPARE(model.rowCount(block), 0);
+  QCOMPARE(int(pending.size()), 1);
+  QCOMPARE(pending[0].first, model.nodeFromIndex(block));
+  QCOMPARE(pending[0].second, 8);
+  QCOMPARE(int(index.find(QStringLiteral("movel")).size()), moves); // the tail
+
+  model.fetchMore(block);
+  const std::vector<CommandNode*> found = index.find(QStringLiteral("P=(4242,"), &pending);
+  QVERIFY(pending.empty());
+  QCOMPARE(int(found.size()), 1);
+  QCOMPARE(model.indexFromNode(found[0]), model.index(7, 0, block));
+}
+
+QTEST_MAIN(TestProgramCompiler)
+#include "tst_programcompiler.moc"
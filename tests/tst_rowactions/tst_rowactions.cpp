@@ -0,0 +1,252 @@
+#include <QLabel>
+#include <QPushButton>
+#include <QSignalSpy>
+#include <QtTest>
+#include "commandrowwidget.h"
+#include "commandtreeview.h"
+#include "hyprgcommand.h"
+
+using namespace rp;
+
+// Row buttons and title clicks, painted by RowDelegate and on pooled
+// CommandRowWidgets: every action reaches CommandTreeView's signals exactly
+// once, for the row that was clicked, also after rows have moved.
+class TestRowActions : public QObject {
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void init();
+  void cleanup();
+  void paintedRows();
+  void pooledWidgets();
+  void recycledWidgetsFireOnce();
+  void batchActionsReportAffectedRows();
+
+private:
+  enum Button { Up, Down, Delete };
+
+  Command* commandAt(int row) const;
+  QModelIndex indexOf(const Command* c) const;
+  // RowDelegate: presses and releases on the painted parts of a row
+  void clickPainted(int row, Button button);
+  void clickPaintedTitle(int row);
+  // CommandRowWidget bound to the row
+  CommandRowWidget* widgetAt(int row) const;
+  void clickWidget(int row, Button button);
+  void clickWidgetTitle(int row);
+  void verifyCounts(int moved, int deleted, int clicked);
+
+  CommandTreeView* m_view {nullptr};
+  QSignalSpy* m_moved {nullptr};
+  QSignalSpy* m_deleted {nullptr};
+  QSignalSpy* m_clicked {nullptr};
+};
+
+void TestRowActions::initTestCase() {
+  qRegisterMetaType<rp::Command*>();
+}
+
+// Start plus five MoveL at the top level
+void TestRowActions::init() {
+  m_view = new CommandTreeView;
+  m_view->resize(600, 400);
+  std::vector<CommandPtr> moves;
+  for (int i = 0; i < 5; ++i) moves.push_back(makePooled<HyMoveLCommand>());
+  QVERIFY(m_view->model()->insertCommands(QModelIndex(), -1, moves));
+  m_view->show();
+  QVERIFY(QTest::qWaitForWindowExposed(m_view));
+
+  m_moved = new QSignalSpy(m_view, &CommandTreeView::commandMoved);
+  m_deleted = new QSignalSpy(m_view, &CommandTreeView::commandWillBeDeleted);
+  m_clicked = new QSignalSpy(m_view, &CommandTreeView::commandClicked);
+  QVERIFY(m_moved->isValid() && m_deleted->isValid() && m_clicked->isValid());
+}
+
+void TestRowActions::cleanup() {
+  delete m_moved;
+  delete m_deleted;
+  delete m_clicked;
+  delete m_view;
+  m_moved = m_deleted = m_clicked = nullptr;
+  m_view = nullptr;
+}
+
+Command* TestRowActions::commandAt(int row) const {
+  return m_view->model()->commandFromIndex(m_view->model()->index(row, 0, QModelIndex()));
+}
+
+QModelIndex TestRowActions::indexOf(const Command* c) const {
+  return m_view->model()->findIndexByCommand(c);
+}
+
+// RowDelegate's layout: 6 px side margins, three 28 px buttons 6 px apart
+// at the right edge
+void TestRowActions::clickPainted(int row, Button button) {
+  const QRect r = m_view->visualRect(m_view->model()->index(row, 0, QModelIndex()));
+  const int right = r.right() + 1 - 6;
+  const int left = right - (3 - button) * 28 - (2 - button) * 6;
+  QTest::mouseClick(m_view->viewport(), Qt::LeftButton, Qt::NoModifier,
+                    QPoint(left + 14, r.center().y()));
+  QCoreApplication::processEvents();
+}
+
+void TestRowActions::clickPaintedTitle(int row) {
+  const QRect r = m_view->visualRect(m_view->model()->index(row, 0, QModelIndex()));
+  QTest::mouseClick(m_view->viewport(), Qt::LeftButton, Qt::NoModifier,
+                    QPoint(r.left() + r.width() / 3, r.center().y()));
+  QCoreApplication::processEvents();
+}
+
+CommandRowWidget* TestRowActions::widgetAt(int row) const {
+  const QModelIndex idx = m_view->model()->index(row, 0, QModelIndex());
+  CommandRowWidget* found = nullptr;
+  for (CommandRowWidget* w : m_view->viewport()->findChildren<CommandRowWidget*>()) {
+    if (!w->isVisible() || w->index() != idx) continue;
+    if (found) return nullptr; // two widgets bound to one row
+    found = w;
+  }
+  return found;
+}
+
+// waits for the queued row layout to bind a widget to the row
+void TestRowActions::clickWidget(int row, Button button) {
+  QTRY_VERIFY(widgetAt(row));
+  CommandRowWidget* w = widgetAt(row);
+  static const char* const tips[] = {"Move up", "Move down", "Delete"};
+  QPushButton* target = nullptr;
+  for (QPushButton* b : w->findChildren<QPushButton*>()) {
+    if (b->toolTip() == QLatin1String(tips[button])) target = b;
+  }
+  QVERIFY(target);
+  QVERIFY(target->isEnabled());
+  QTest::mouseClick(target, Qt::LeftButton);
+}
+
+void TestRowActions::clickWidgetTitle(int row) {
+  QTRY_VERIFY(widgetAt(row));
+  CommandRowWidget* w = widgetAt(row);
+  QLabel* title = nullptr;
+  for (QLabel* l : w->findChildren<QLabel*>()) {
+    if (l->text().startsWith(QLatin1String("MoveL"))) title = l;
+  }
+  QVERIFY(title);
+  QTest::mouseClick(title, Qt::LeftButton);
+}
+
+void TestRowActions::verifyCounts(int moved, int deleted, int clicked) {
+  QCOMPARE(m_moved->count(), moved);
+  QCOMPARE(m_deleted->count(), deleted);
+  QCOMPARE(m_clicked->count(), clicked);
+}
+
+void TestRowActions::paintedRows() {
+  QVERIFY(!m_view->rowWidgets());
+
+  Command* third = commandAt(3);
+  clickPainted(3, Up);
+  verifyCounts(1, 0, 0);
+  QCOMPARE(m_moved->at(0).at(0).value<Command*>(), third);
+  QCOMPARE(indexOf(third).row(), 2);
+
+  clickPainted(2, Down);
+  verifyCounts(2, 0, 0);
+  QCOMPARE(m_moved->at(1).at(0).value<Command*>(), third);
+  QCOMPARE(indexOf(third).row(), 3);
+
+  Command* first = commandAt(1);
+  clickPaintedTitle(1);
+  verifyCounts(2, 0, 1);
+  QCOMPARE(m_clicked->at(0).at(0).value<Command*>(), first);
+
+  Command* victim = commandAt(4);
+  clickPainted(4, Delete);
+  verifyCounts(2, 1, 1);
+  QCOMPARE(m_deleted->at(0).at(0).value<Command*>(), victim);
+  QCOMPARE(m_view->model()->rowCount(QModelIndex()), 5);
+  QVERIFY(!indexOf(victim).isValid());
+
+  // Start has no enabled buttons; the first command can't move above it
+  clickPainted(0, Delete);
+  clickPainted(1, Up);
+  verifyCounts(2, 1, 1);
+}
+
+void TestRowActions::pooledWidgets() {
+  m_view->setRowWidgets(true);
+
+  Command* third = commandAt(3);
+  clickWidget(3, Up);
+  verifyCounts(1, 0, 0);
+  QCOMPARE(m_moved->at(0).at(0).value<Command*>(), third);
+  QCOMPARE(indexOf(third).row(), 2);
+
+  // the row is now shown by whichever widget the layout bound to it
+  clickWidget(2, Up);
+  verifyCounts(2, 0, 0);
+  QCOMPARE(indexOf(third).row(), 1);
+
+  clickWidget(1, Down);
+  verifyCounts(3, 0, 0);
+  QCOMPARE(m_moved->at(2).at(0).value<Command*>(), third);
+  QCOMPARE(indexOf(third).row(), 2);
+
+  clickWidgetTitle(2);
+  verifyCounts(3, 0, 1);
+  QCOMPARE(m_clicked->at(0).at(0).value<Command*>(), third);
+
+  clickWidget(2, Delete);
+  verifyCounts(3, 1, 1);
+  QCOMPARE(m_deleted->at(0).at(0).value<Command*>(), third);
+  QVERIFY(!indexOf(third).isValid());
+}
+
+// Widgets go back to the pool and are rebound, possibly to other rows;
+// they must not pick up a second connection on the way.
+void TestRowActions::recycledWidgetsFireOnce() {
+  m_view->setRowWidgets(true);
+  m_view->setRowWidgets(false);
+  m_view->setRowWidgets(true);
+
+  Command* last = commandAt(5);
+  clickWidget(5, Up);
+  verifyCounts(1, 0, 0);
+  QCOMPARE(m_moved->at(0).at(0).value<Command*>(), last);
+
+  clickWidgetTitle(4);
+  verifyCounts(1, 0, 1);
+  QCOMPARE(m_clicked->at(0).at(0).value<Command*>(), last);
+
+  // back to painted rows: the hidden widgets stay silent
+  m_view->setRowWidgets(false);
+  clickPainted(4, Down);
+  verifyCounts(2, 0, 1);
+  QCOMPARE(indexOf(last).row(), 5);
+}
+
+// The context menu announces what the batch API reports, not the selection:
+// Start and runs that can't move are left out.
+void TestRowActions::batchActionsReportAffectedRows() {
+  CommandModel* model = m_view->model();
+  Command* first = commandAt(1);
+  Command* second = commandAt(2);
+  Command* fourth = commandAt(4);
+  const QModelIndexList selection = {model->index(0, 0, QModelIndex()), indexOf(first),
+                                     indexOf(second), indexOf(fourth)};
+
+  // Start and the run right under it stay, the fourth row moves
+  std::vector<Command*> moved;
+  QVERIFY(model->moveUp(selection, &moved));
+  QCOMPARE(moved, std::vector<Command*>{fourth});
+
+  moved.clear();
+  QVERIFY(!model->moveToRoot({indexOf(fourth)}, 4, &moved)); // already there
+  QVERIFY(moved.empty());
+
+  const QModelIndexList again = {model->index(0, 0, QModelIndex()), indexOf(first),
+                                 indexOf(second), indexOf(fourth)};
+  const std::vector<Command*> doomed = model->removalTargets(again);
+  QCOMPARE(doomed, (std::vector<Command*>{first, second, fourth}));
+}
+
+QTEST_MAIN(TestRowActions)
+#include "tst_rowactions.moc"
@@ -0,0 +1,11 @@
+QT += testlib widgets
+
+CONFIG += c++17 testcase
+CONFIG -= app_bundle
+
+TARGET = tst_rowactions
+
+SOURCES += \
+    tst_rowactions.cpp
+
+include(../../widget/widget.pri)
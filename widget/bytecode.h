@@ -0,0 +1,51 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <QtGlobal>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "command.h"
+
+namespace rp {
+
+/**
+ * Bytecode
+ * Linear form of a program for executors and exporters: one fixed-size
+ * instruction per command in program order, block structure turned into
+ * relative jumps and motion parameters packed in their own array.
+*/
+enum class OpCode : uint8_t {
+  Start,      // program entry
+  MoveL,      // arg: index into motions
+  JumpIfNot,  // If: when the condition fails, skip `arg` instructions (the block)
+  Exec,       // command without a compiled form, run through its Command
+  End         // appended after the last command
+};
+
+struct Instruction {
+  OpCode op;
+  uint8_t reserved[3];
+  int32_t arg;
+};
+static_assert(sizeof(Instruction) == 8, "Instruction layout");
+
+struct MotionRecord {
+  double x, y, z, speed;
+};
+
+struct Bytecode {
+  std::vector<Instruction> code;
+  std::vector<MotionRecord> motions;
+  // Command::id() per instruction, to map back to rows (0 for End). Ids
+  // stay meaningful after the command is deleted, unlike pointers.
+  std::vector<quint64> source;
+  quint64 structureRevision {0};
+  quint64 dataRevision {0};
+};
+
+using BytecodePtr = std::shared_ptr<const Bytecode>;
+
+}
+
+#endif // BYTECODE_H
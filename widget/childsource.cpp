@@ -0,0 +1,111 @@
+#include "childsource.h"
+#include "commandnode.h"
+
+namespace rp {
+
+NodeAggregate ChildSource::remainingAggregate() const {
+  const int left = remainingNodes();
+  NodeAggregate total;
+  if (left <= kAggregateChunk) {
+    m_suffix.clear();
+    m_suffixBase = -1;
+    visit(0, [&](const PendingRow& r) { total.append(NodeAggregate::of(r.command)); return true; });
+    return total;
+  }
+
+  if (m_suffixBase < 0) {
+    std::vector<NodeAggregate> chunks;
+    NodeAggregate chunk;
+    int n = 0;
+    visit(0, [&](const PendingRow& r) {
+      chunk.append(NodeAggregate::of(r.command));
+      if (++n % kAggregateChunk == 0) {
+        chunks.push_back(chunk);
+        chunk = NodeAggregate();
+      }
+      return true;
+    });
+    if (n % kAggregateChunk != 0) chunks.push_back(chunk);
+    for (int i = static_cast<int>(chunks.size()) - 2; i >= 0; --i) {
+      chunks[i].append(chunks[i + 1]);
+    }
+    m_suffix = std::move(chunks);
+    m_suffixBase = left;
+  }
+
+  // rest of the chunk take() has started on, then the suffix after it
+  const int consumed = m_suffixBase - left;
+  const int chunk = consumed / kAggregateChunk;
+  int head = (chunk + 1) * kAggregateChunk - consumed;
+  visit(0, [&](const PendingRow& r) {
+    total.append(NodeAggregate::of(r.command));
+    return --head > 0;
+  });
+  if (chunk + 1 < static_cast<int>(m_suffix.size())) total.append(m_suffix[chunk + 1]);
+  return total;
+}
+
+void CommandListSource::countNodes() const {
+  if (!m_nodesBefore.empty()) return;
+  m_nodesBefore.reserve(m_entries.size() + 1);
+  int n = 0;
+  for (const Entry& e : m_entries) {
+    m_nodesBefore.push_back(n);
+    n += 1 + (e.children ? e.children->remainingNodes() : 0);
+  }
+  m_nodesBefore.push_back(n);
+}
+
+int CommandListSource::remainingNodes() const {
+  if (remaining() == 0) return 0;
+  countNodes();
+  return m_nodesBefore.back() - m_nodesBefore[m_next];
+}
+
+std::vector<std::unique_ptr<CommandNode>> CommandListSource::take(int max) {
+  std::vector<std::unique_ptr<CommandNode>> out;
+  const int n = std::min(max, remaining());
+  countNodes(); // positions must survive the children moving out
+  out.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    Entry& e = m_entries[m_next++];
+    auto node = std::make_unique<CommandNode>(std::move(e.command));
+    node->setChildSource(std::move(e.children));
+    out.push_back(std::move(node));
+  }
+  if (m_next == m_entries.size()) {
+    // everything handed out, give the memory back
+    std::vector<Entry>().swap(m_entries);
+    std::vector<int>().swap(m_nodesBefore);
+    m_next = 0;
+  }
+  return out;
+}
+
+bool CommandListSource::visit(int skip, const Visitor& fn) const {
+  if (skip >= remainingNodes()) return true;
+  const int target = m_nodesBefore[m_next] + skip;
+  // last entry starting at or before the target
+  auto it = std::upper_bound(m_nodesBefore.begin() + static_cast<std::ptrdiff_t>(m_next),
+                             m_nodesBefore.end() - 1, target);
+  std::size_t i = static_cast<std::size_t>(std::prev(it) - m_nodesBefore.begin());
+  skip = target - m_nodesBefore[i];
+  for (; i < m_entries.size(); ++i, skip = 0) {
+    const Entry& e = m_entries[i];
+    if (skip == 0) {
+      const bool hasChildren = e.children && e.children->remaining() > 0;
+      if (!fn({e.command.get(), 0, hasChildren})) return false;
+    } else {
+      --skip;
+    }
+    if (e.children) {
+      const bool more = e.children->visit(skip, [&](const PendingRow& r) {
+        return fn({r.command, r.depth + 1, r.hasChildren});
+      });
+      if (!more) return false;
+    }
+  }
+  return true;
+}
+
+}
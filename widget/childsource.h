@@ -0,0 +1,104 @@
+#ifndef CHILDSOURCE_H
+#define CHILDSOURCE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "command.h"
+#include "nodeaggregate.h"
+
+namespace rp {
+
+class CommandNode;
+
+/**
+ * Child source
+ * Children of a node that exist only in their serialized or pending form.
+ * CommandModel turns them into CommandNodes batch by batch from fetchMore(),
+ * so a collapsed block costs nothing until the user opens it.
+ *
+ * Pending rows still count: the owner's subtree size includes
+ * remainingNodes() and its totals include remainingAggregate(), so row
+ * numbers and block totals are right before anything is fetched. Whole-
+ * program passes read pending rows through visit() instead of fetching them.
+*/
+class ChildSource {
+public:
+  // A pending row as visit() reports it. `command` is only valid during the
+  // callback; `depth` is 0 for the owner's own children.
+  struct PendingRow {
+    const Command* command;
+    int depth;
+    bool hasChildren;
+  };
+  using Visitor = std::function<bool(const PendingRow&)>;
+
+  virtual ~ChildSource() = default;
+
+  // Children not handed out yet.
+  virtual int remaining() const = 0;
+
+  // Nodes behind remaining(), descendants included.
+  virtual int remainingNodes() const = 0;
+
+  // Next `max` children in program order. Returned nodes may carry their own
+  // source for their children.
+  virtual std::vector<std::unique_ptr<CommandNode>> take(int max) = 0;
+
+  // Calls `fn` for the remaining nodes in program order, starting `skip`
+  // nodes in, without building any. Returns false if `fn` stopped the walk
+  // by returning false.
+  virtual bool visit(int skip, const Visitor& fn) const = 0;
+
+  // Totals of the remaining nodes. The first call walks them once and keeps
+  // one suffix total per chunk of rows; later calls only re-walk the part of
+  // a chunk that take() has not consumed yet.
+  NodeAggregate remainingAggregate() const;
+
+private:
+  static constexpr int kAggregateChunk = 256;
+
+  mutable std::vector<NodeAggregate> m_suffix; // chunk i..end, from m_suffixBase
+  mutable int m_suffixBase {-1};               // remainingNodes() when built
+};
+
+// In-memory source: commands already exist, nodes and rows are created on
+// demand. Entries are appended before the source is handed to a node.
+class CommandListSource : public ChildSource {
+public:
+  struct Entry {
+    CommandPtr command;
+    std::unique_ptr<ChildSource> children; // may be null
+  };
+
+  void append(CommandPtr cmd, std::unique_ptr<ChildSource> children = nullptr) {
+    m_entries.push_back({std::move(cmd), std::move(children)});
+    m_nodesBefore.clear();
+  }
+
+  // Gives the last appended entry its children, for builders that only
+  // learn about them from the next entry (e.g. a depth-first reader).
+  void setLastChildren(std::unique_ptr<ChildSource> children) {
+    m_entries.back().children = std::move(children);
+    m_nodesBefore.clear();
+  }
+
+  int remaining() const override {
+    return static_cast<int>(m_entries.size() - m_next);
+  }
+
+  int remainingNodes() const override;
+  std::vector<std::unique_ptr<CommandNode>> take(int max) override;
+  bool visit(int skip, const Visitor& fn) const override;
+
+private:
+  void countNodes() const;
+
+  std::vector<Entry> m_entries;
+  std::size_t m_next {0};
+  mutable std::vector<int> m_nodesBefore; // per entry, plus the total; built on demand
+};
+
+}
+
+#endif // CHILDSOURCE_H
@@ -1,7 +1,16 @@
 #include "command.h"
+#include <QHash>
 
 namespace rp {
 
-int BaseCommand::auto_cmd_increase_index = 0;
+std::atomic<quint64> BaseCommand::s_nextId {1}; // 0 is never a valid id
+
+static QHash<QString, CommandFactory>& REG() { static QHash<QString, CommandFactory> r; return r; }
+
+void CommandRegistry::registerCommand(const QString& t, CommandFactory f) { REG().insert(t, std::move(f)); }
+CommandPtr CommandRegistry::create(const QString& t) {
+  auto it = REG().find(t);
+  return it==REG().end() ? nullptr : it.value()();
+}
 
 }
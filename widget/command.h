@@ -2,7 +2,11 @@
 #define COMMAND_H
 
 #include <QString>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include "nametable.h"
+#include "slabpool.h"
 
 // namespace rp == robot program
 namespace rp {
@@ -12,30 +16,68 @@ public:
   enum class Type { Base, Start, If, MoveL, Custom };
   virtual ~Command() = default;
 
+  // Unique for the whole session and never reused; clone() keeps it, so a
+  // snapshot copy has the id of the command it was taken from.
+  virtual quint64 id() const = 0;
   virtual QString typeName() const = 0;
-  virtual QString commandName() = 0;
+  virtual QString commandName() const = 0;
   virtual void setCommandName(QString name) = 0;
+  // false while commandName() is a generated default (not worth saving)
+  virtual bool hasCustomName() const { return true; }
+  // commandName() interned, for name lookups; NameTable::kNone while the
+  // name is a generated default.
+  virtual NameTable::Id nameId() const {
+    return hasCustomName() ? NameTable::intern(commandName()) : NameTable::kNone;
+  }
   virtual QString info() const { return {}; }
   virtual Type type() const = 0;
   virtual const bool isAllowChild() const = 0;
+  // Independent copy with the same name and parameters (used for snapshots)
+  virtual std::shared_ptr<Command> clone() const = 0;
+
+  // Numeric parameters, indexed 0..paramCount()-1. Undo history records
+  // edits through these, so a command without parameters needs nothing.
+  virtual int paramCount() const { return 0; }
+  virtual QString paramName(int i) const { return QString::number(i); }
+  virtual double param(int i) const { Q_UNUSED(i); return 0.0; }
+  virtual void setParam(int i, double value) { Q_UNUSED(i); Q_UNUSED(value); }
 };
 
 class BaseCommand : public Command {
 public:
-  BaseCommand() {
-    m_commandName = "cmd_" + QString::number(auto_cmd_increase_index++, 10);
+  BaseCommand() : m_id(s_nextId.fetch_add(1, std::memory_order_relaxed)) {
+
+  }
+
+  quint64 id() const override {
+    return m_id;
   }
 
   virtual QString typeName() const override {
     return QStringLiteral("Base (not use)");
   }
 
-  QString commandName() override {
-    return m_commandName;
+  // The default "cmd_N" name is only formatted when asked for, so creating a
+  // command does not allocate a string.
+  QString commandName() const override {
+    if (m_name == NameTable::kNone) {
+      return "cmd_" + QString::number(m_id, 10);
+    }
+    return NameTable::name(m_name);
   }
 
+  // Rows already in a CommandModel are renamed through
+  // CommandModel::renameCommand() so its name index follows.
   void setCommandName(QString name) override {
-    m_commandName = name;
+    m_name = NameTable::intern(name);
+  }
+
+  bool hasCustomName() const override {
+    return m_name != NameTable::kNone;
+  }
+
+  NameTable::Id nameId() const override {
+    return m_name;
   }
 
   virtual QString info() const override {
@@ -50,28 +92,39 @@ public:
     return false;
   }
 
+  virtual std::shared_ptr<Command> clone() const override {
+    return makePooled<BaseCommand>(*this);
+  }
+
 protected:
-  QString m_commandName;
+  NameTable::Id m_name {NameTable::kNone}; // kNone until renamed
 
 private:
-  static int auto_cmd_increase_index;
+  quint64 m_id;
+
+  static std::atomic<quint64> s_nextId; // loaders create commands off the GUI thread
 };
 
 // ---------------- Example commands ----------------
 class StartCommand final : public BaseCommand {
 public:
   StartCommand() {
-    m_commandName = "Start_point";
+    m_name = NameTable::intern(QStringLiteral("Start_point"));
   }
 
   QString typeName() const override {
     return QStringLiteral("Start");
   }
 
-  QString commandName() override {
+  QString commandName() const override {
     return QStringLiteral("Start point");
   }
 
+  NameTable::Id nameId() const override {
+    static const NameTable::Id id = NameTable::intern(QStringLiteral("Start point"));
+    return id;
+  }
+
   QString info() const override {
     return QStringLiteral("Program entry");
   }
@@ -83,6 +136,10 @@ public:
   const bool isAllowChild() const override {
     return false;
   }
+
+  std::shared_ptr<Command> clone() const override {
+    return makePooled<StartCommand>(*this);
+  }
 };
 
 
@@ -113,6 +170,15 @@ public:
 
 using CommandPtr = std::shared_ptr<Command>;
 
+// Factory kiểu: tạo command theo typeName (dùng khi đọc chương trình từ file)
+using CommandFactory = std::function<CommandPtr()>;
+
+class CommandRegistry {
+public:
+  static void registerCommand(const QString& typeName, CommandFactory f);
+  static CommandPtr create(const QString& typeName);
+};
+
 } // namespace rp
 
 #endif // COMMAND_H
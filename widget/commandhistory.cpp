@@ -0,0 +1,152 @@
+#include "commandhistory.h"
+#include <QDateTime>
+
+namespace rp {
+
+// rough heap cost of one pooled command with its control block and name
+static constexpr std::size_t kCommandBytes = 96;
+
+void CommandHistory::record(Delta delta) {
+  if (!isRecording()) {
+    return;
+  }
+  Group group(*this);
+  m_pending.deltas.push_back(std::move(delta));
+}
+
+void CommandHistory::beginGroup() {
+  ++m_groupDepth;
+}
+
+void CommandHistory::endGroup() {
+  if (--m_groupDepth > 0 || m_pending.deltas.empty()) {
+    return;
+  }
+  Step step = std::move(m_pending);
+  m_pending = Step{};
+  step.timestampMs = QDateTime::currentMSecsSinceEpoch();
+
+  // a new action invalidates everything that was undone
+  for (const Step& s : m_redo) m_bytes -= s.bytes;
+  m_redo.clear();
+
+  if (!tryMerge(step)) {
+    step.bytes = estimateBytes(step);
+    m_bytes += step.bytes;
+    m_undo.push_back(std::move(step));
+    enforceLimit();
+  }
+  notify();
+}
+
+// Spinbox bursts: a single parameter edit on the same command as the
+// previous step, shortly after it, extends that step instead of adding one.
+bool CommandHistory::tryMerge(Step& step) {
+  if (m_undo.empty() || step.deltas.size() != 1) {
+    return false;
+  }
+  Step& last = m_undo.back();
+  if (last.deltas.size() != 1) {
+    return false;
+  }
+  const Delta& d = step.deltas.front();
+  Delta& prev = last.deltas.front();
+  if (d.kind != Delta::Kind::Edit || prev.kind != Delta::Kind::Edit || d.node != prev.node) {
+    return false;
+  }
+  if (step.timestampMs - last.timestampMs > m_mergeWindowMs) {
+    return false;
+  }
+
+  for (const ParamChange& c : d.params) {
+    bool found = false;
+    for (ParamChange& p : prev.params) {
+      if (p.index == c.index) {
+        p.after = c.after;
+        found = true;
+        break;
+      }
+    }
+    if (!found) prev.params.push_back(c);
+  }
+  last.timestampMs = step.timestampMs;
+  m_bytes -= last.bytes;
+  last.bytes = estimateBytes(last);
+  m_bytes += last.bytes;
+  return true;
+}
+
+CommandHistory::Step CommandHistory::takeUndo() {
+  Step s = std::move(m_undo.back());
+  m_undo.pop_back();
+  m_bytes -= s.bytes;
+  return s;
+}
+
+CommandHistory::Step CommandHistory::takeRedo() {
+  Step s = std::move(m_redo.back());
+  m_redo.pop_back();
+  m_bytes -= s.bytes;
+  return s;
+}
+
+void CommandHistory::pushUndone(Step step) {
+  step.bytes = estimateBytes(step);
+  m_bytes += step.bytes;
+  m_redo.push_back(std::move(step));
+  notify();
+}
+
+void CommandHistory::pushRedone(Step step) {
+  step.bytes = estimateBytes(step);
+  step.timestampMs = 0; // never merge into a redone step
+  m_bytes += step.bytes;
+  m_undo.push_back(std::move(step));
+  enforceLimit();
+  notify();
+}
+
+void CommandHistory::clear() {
+  m_undo.clear();
+  m_redo.clear();
+  m_pending = Step{};
+  m_bytes = 0;
+  notify();
+}
+
+void CommandHistory::setMemoryLimit(std::size_t bytes) {
+  m_limit = bytes;
+  enforceLimit();
+  notify();
+}
+
+void CommandHistory::enforceLimit() {
+  while (m_bytes > m_limit && !m_undo.empty()) {
+    m_bytes -= m_undo.front().bytes;
+    m_undo.pop_front();
+  }
+}
+
+std::size_t CommandHistory::estimateBytes(const Step& step) {
+  std::size_t bytes = sizeof(Step);
+  for (const Delta& d : step.deltas) {
+    bytes += sizeof(Delta) + d.params.capacity() * sizeof(ParamChange)
+           + d.edits.capacity() * sizeof(RowEdit);
+    for (const auto& n : d.owned) {
+      // subtreeSize() also counts rows still pending in a ChildSource, which
+      // hold no node or command yet
+      std::size_t nodes = 0;
+      std::vector<const CommandNode*> stack{n.get()};
+      while (!stack.empty()) {
+        const CommandNode* c = stack.back();
+        stack.pop_back();
+        ++nodes;
+        for (int i = 0; i < c->childCount(); ++i) stack.push_back(c->child(i));
+      }
+      bytes += nodes * (sizeof(CommandNode) + kCommandBytes);
+    }
+  }
+  return bytes;
+}
+
+}
@@ -0,0 +1,135 @@
+#ifndef COMMANDHISTORY_H
+#define COMMANDHISTORY_H
+
+#include <QtGlobal>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "commandnode.h"
+
+namespace rp {
+
+/**
+ * Command history
+ * Undo/redo storage for CommandModel. Steps hold compact deltas (where rows
+ * went, which parameters changed) instead of tree copies; only removed or
+ * undone-inserted rows are kept alive, as the very nodes that left the tree.
+ * Node pointers inside a delta stay valid because every structural change
+ * goes through the history and undo/redo replay them in exact order.
+ * The model applies the deltas, this class only records, merges and trims.
+*/
+class CommandHistory {
+public:
+  struct ParamChange {
+    int index;
+    double before;
+    double after;
+  };
+
+  struct RowEdit {
+    CommandNode* node;
+    ParamChange change;
+  };
+
+  struct Delta {
+    enum class Kind { Insert, Remove, Move, Edit, BatchEdit };
+    Kind kind {Kind::Insert};
+
+    // Insert/Remove: rows [row, row + count) of parent.
+    // Move: rows [row, row + count) of parent went to dstParent at dstRow
+    // (final position of the first row).
+    CommandNode* parent {nullptr};
+    int row {0};
+    int count {0};
+    CommandNode* dstParent {nullptr};
+    int dstRow {0};
+
+    // Edit
+    CommandNode* node {nullptr};
+    std::vector<ParamChange> params;
+
+    // BatchEdit: one parameter change on each of many rows
+    std::vector<RowEdit> edits;
+
+    // rows currently outside the tree (removed, or inserted and undone)
+    std::vector<std::unique_ptr<CommandNode>> owned;
+  };
+
+  struct Step {
+    std::vector<Delta> deltas;
+    std::size_t bytes {0};
+    qint64 timestampMs {0};
+  };
+
+  // Groups every delta recorded between construction and destruction into a
+  // single undo step. Nested groups fold into the outermost one.
+  class Group {
+  public:
+    explicit Group(CommandHistory& h) : m_h(h) { m_h.beginGroup(); }
+    ~Group() { m_h.endGroup(); }
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+  private:
+    CommandHistory& m_h;
+  };
+
+  // Suspends recording while the model replays a step.
+  class Replay {
+  public:
+    explicit Replay(CommandHistory& h) : m_h(h) { ++m_h.m_replaying; }
+    ~Replay() { --m_h.m_replaying; }
+    Replay(const Replay&) = delete;
+    Replay& operator=(const Replay&) = delete;
+  private:
+    CommandHistory& m_h;
+  };
+
+  bool isRecording() const { return m_replaying == 0; }
+  void record(Delta delta);
+
+  bool canUndo() const { return !m_undo.empty(); }
+  bool canRedo() const { return !m_redo.empty(); }
+
+  // The model pops a step, applies it and pushes it back on the other side.
+  Step takeUndo();
+  Step takeRedo();
+  void pushUndone(Step step);
+  void pushRedone(Step step);
+
+  void clear();
+
+  // Called whenever canUndo()/canRedo() may have changed.
+  void setChangedCallback(std::function<void()> cb) { m_changed = std::move(cb); }
+
+  // Oldest steps are dropped once the history uses more than this.
+  void setMemoryLimit(std::size_t bytes);
+  std::size_t memoryLimit() const { return m_limit; }
+  std::size_t memoryUsage() const { return m_bytes; }
+
+  // Consecutive edits of the same command closer than this merge into one step.
+  void setMergeWindow(qint64 ms) { m_mergeWindowMs = ms; }
+
+private:
+  void beginGroup();
+  void endGroup();
+  bool tryMerge(Step& step);
+  void enforceLimit();
+  void notify() { if (m_changed) m_changed(); }
+  static std::size_t estimateBytes(const Step& step);
+
+  std::deque<Step> m_undo;
+  std::vector<Step> m_redo;
+  Step m_pending;
+  int m_groupDepth {0};
+  int m_replaying {0};
+  std::size_t m_bytes {0};
+  std::size_t m_limit {16u * 1024u * 1024u};
+  qint64 m_mergeWindowMs {1500};
+  std::function<void()> m_changed;
+};
+
+}
+
+#endif // COMMANDHISTORY_H
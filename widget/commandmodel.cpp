@@ -1,12 +1,14 @@
 #include "commandmodel.h"
 #include <QApplication>
+#include <algorithm>
+#include <utility>
 
 namespace rp
 {
 static std::unique_ptr<CommandNode> makeRoot() {
   auto root = std::make_unique<CommandNode>(CommandPtr{});
   // Ensure Start at root row 0
-  auto start = std::make_unique<CommandNode>(std::make_shared<StartCommand>(), root.get());
+  auto start = std::make_unique<CommandNode>(makePooled<StartCommand>(), root.get());
   root->appendChild(std::move(start));
   return root;
 }
@@ -14,7 +16,35 @@ static std::unique_ptr<CommandNode> makeRoot() {
 CommandModel::CommandModel(QObject* parent)
     : QAbstractItemModel(parent)
     , m_root(makeRoot()) {
-
+  indexSubtree(m_root.get());
+
+  // any structural change invalidates the flat mirror
+  auto structureChanged = [this]{ ++m_structureRevision; };
+  connect(this, &QAbstractItemModel::rowsInserted, this, structureChanged);
+  connect(this, &QAbstractItemModel::rowsRemoved, this, structureChanged);
+  connect(this, &QAbstractItemModel::rowsMoved, this, structureChanged);
+  connect(this, &QAbstractItemModel::modelReset, this, structureChanged);
+  connect(this, &QAbstractItemModel::layoutChanged, this, structureChanged);
+
+  // a reset replaces the whole program, old deltas no longer apply
+  connect(this, &QAbstractItemModel::modelReset, this, [this]{ m_history.clear(); });
+  m_history.setChangedCallback([this]{ emit historyChanged(); });
+
+  // edited commands drop their frozen snapshot copy
+  connect(this, &QAbstractItemModel::dataChanged, this,
+          [this](const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                 const QList<int>& roles) {
+            if (isDiagnosticsOnly(roles)) return;
+            ++m_dataRevision;
+            for (int r = topLeft.row(); r <= bottomRight.row(); ++r) {
+              if (CommandNode* n = nodeFromIndex(index(r, 0, topLeft.parent()))) {
+                n->invalidateFrozen();
+                n->markAggregateDirty();
+                indexName(n); // may have been renamed
+                if (n->command()) m_moveLEdited.insert(n->command().get());
+              }
+            }
+          });
 }
 
 CommandModel::~CommandModel() = default;
@@ -72,6 +102,21 @@ QVariant CommandModel::data(const QModelIndex& idx, int role) const {
   else if (role == Qt::ToolTipRole && isStart) {
     return QStringLiteral("Start node (pinned at index 0)");
   }
+  else if (role == MoveCountRole) {
+    return node->aggregate().moveCount;
+  }
+  else if (role == PathLengthRole) {
+    return node->aggregate().pathLength;
+  }
+  else if (role == EstimatedTimeRole) {
+    return node->aggregate().estimatedTime;
+  }
+  else if (role == DiagnosticsRole) {
+    return m_diagnostics.value(node).messages;
+  }
+  else if (role == DiagnosticSeverityRole) {
+    return m_diagnostics.value(node).severity;
+  }
   return {};
 }
 
@@ -81,6 +126,82 @@ Qt::ItemFlags CommandModel::flags(const QModelIndex& idx) const {
   return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsEditable;
 }
 
+bool CommandModel::hasChildren(const QModelIndex& parentIdx) const {
+  CommandNode* n = parentIdx.isValid() ? nodeFromIndex(parentIdx) : m_root.get();
+  return n && (n->childCount() > 0 || n->hasPendingChildren());
+}
+
+bool CommandModel::canFetchMore(const QModelIndex& parentIdx) const {
+  CommandNode* n = parentIdx.isValid() ? nodeFromIndex(parentIdx) : m_root.get();
+  return n && n->hasPendingChildren();
+}
+
+void CommandModel::fetchMore(const QModelIndex& parentIdx) {
+  CommandNode* n = parentIdx.isValid() ? nodeFromIndex(parentIdx) : m_root.get();
+  if (n) fetchPending(n, kFetchBatch);
+}
+
+bool CommandModel::setChildSource(const QModelIndex& parentIdx, std::unique_ptr<ChildSource> source) {
+  CommandNode* p = parentIdx.isValid() ? nodeFromIndex(parentIdx) : m_root.get();
+  if (!p || !source || p->hasPendingChildren()) return false;
+  if (p->command() && !p->command()->isAllowChild()) return false;
+  p->setChildSource(std::move(source));
+  if (p->hasPendingChildren()) m_pendingNodes.insert(p);
+  // the expander may have to appear
+  if (parentIdx.isValid()) emit dataChanged(parentIdx, parentIdx);
+  return true;
+}
+
+void CommandModel::resetProgram(std::unique_ptr<ChildSource> topLevel) {
+  beginResetModel();
+  m_nodeByCommand.clear();
+  m_nodeById.clear();
+  m_nodesByName.clear();
+  m_nameOf.clear();
+  m_diagnostics.clear();
+  m_pendingNodes.clear();
+  m_root = makeRoot();
+  indexSubtree(m_root.get());
+  m_root->setChildSource(std::move(topLevel));
+  if (m_root->hasPendingChildren()) m_pendingNodes.insert(m_root.get());
+  endResetModel();
+}
+
+void CommandModel::fetchAll(const QModelIndex& parentIdx, bool recursive) {
+  CommandNode* p = parentIdx.isValid() ? nodeFromIndex(parentIdx) : m_root.get();
+  if (!p || m_pendingNodes.isEmpty()) return;
+  if (p == m_root.get() && recursive) {
+    // whole program: fetched nodes carrying their own source join the set
+    while (!m_pendingNodes.isEmpty()) {
+      fetchAllPending(*m_pendingNodes.cbegin());
+    }
+    return;
+  }
+  std::vector<CommandNode*> stack{p};
+  while (!stack.empty()) {
+    CommandNode* n = stack.back();
+    stack.pop_back();
+    fetchAllPending(n);
+    if (!recursive) break;
+    for (int i = 0; i < n->childCount(); ++i) stack.push_back(n->child(i));
+  }
+}
+
+// Fetched rows are appended after the materialized ones. Fetching is not an
+// edit, so nothing is recorded in the undo history.
+void CommandModel::fetchPending(CommandNode* node, int max) {
+  if (!node->hasPendingChildren()) return;
+  CommandHistory::Replay notRecorded(m_history);
+  attachNodes(node, node->childCount(), node->takePending(max));
+  if (!node->hasPendingChildren()) m_pendingNodes.remove(node);
+}
+
+void CommandModel::fetchAllPending(CommandNode* node) {
+  while (node->hasPendingChildren()) {
+    fetchPending(node, node->pendingChildCount());
+  }
+}
+
 bool CommandModel::insertSiblingAbove(const QModelIndex& ref, CommandPtr cmd) {
   if (!ref.isValid() || !cmd) {
     return false;
@@ -95,10 +216,9 @@ bool CommandModel::insertSiblingAbove(const QModelIndex& ref, CommandPtr cmd) {
   const bool refIsStart = isStartNode(refNode);
   int insertRow = refIsStart ? atRow + 1 : atRow;
 
-  // beginInsertRows(parent(ref), insertRow, insertRow);
-  beginInsertRows(ref.parent(), insertRow, insertRow);
-  parent->insertChild(insertRow, std::make_unique<CommandNode>(std::move(cmd)));
-  endInsertRows();
+  std::vector<std::unique_ptr<CommandNode>> nodes;
+  nodes.push_back(std::make_unique<CommandNode>(std::move(cmd)));
+  attachNodes(parent, insertRow, std::move(nodes));
   return true;
 }
 
@@ -119,11 +239,123 @@ bool CommandModel::insertChild(const QModelIndex& parentIndex, CommandPtr cmd, i
     }
   }
 
+  fetchAllPending(p); // "append" means after the pending rows too
   int row = (atRow < 0) ? p->childCount() : atRow;
 
-  beginInsertRows(parentIndex, row, row);
-  p->insertChild(row, std::make_unique<CommandNode>(std::move(cmd)));
+  std::vector<std::unique_ptr<CommandNode>> nodes;
+  nodes.push_back(std::make_unique<CommandNode>(std::move(cmd)));
+  attachNodes(p, row, std::move(nodes));
+  return true;
+}
+
+bool CommandModel::insertCommands(const QModelIndex& parentIndex, int atRow,
+                                  const std::vector<CommandPtr>& cmds) {
+  CommandNode* p = parentIndex.isValid()
+                       ? static_cast<CommandNode*>(parentIndex.internalPointer())
+                       : m_root.get();
+  if (!p) {
+    return false;
+  }
+  if (p->command() != nullptr && !p->command()->isAllowChild()) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<CommandNode>> nodes;
+  nodes.reserve(cmds.size());
+  for (const CommandPtr& cmd : cmds) {
+    if (cmd) nodes.push_back(std::make_unique<CommandNode>(cmd));
+  }
+  if (nodes.empty()) {
+    return false;
+  }
+
+  fetchAllPending(p);
+  int row = (atRow < 0 || atRow > p->childCount()) ? p->childCount() : atRow;
+  if (p == m_root.get() && row == 0 && hasStartNode()) row = 1; // Start stays at row 0
+
+  attachNodes(p, row, std::move(nodes));
+  return true;
+}
+
+// ---------------- Primitives ----------------
+// Every structural change goes through attachNodes / detachNodes /
+// relocateNodes: they emit the Qt notifications, keep the command index in
+// sync and record the undo delta. Undo/redo replays them with recording off.
+
+void CommandModel::attachNodes(CommandNode* parentNode, int row,
+                               std::vector<std::unique_ptr<CommandNode>> nodes) {
+  const int count = static_cast<int>(nodes.size());
+  if (count == 0) return;
+  row = std::clamp(row, 0, parentNode->childCount());
+
+  beginInsertRows(indexFromNode(parentNode), row, row + count - 1);
+  for (const auto& n : nodes) {
+    indexSubtree(n.get());
+  }
+  parentNode->insertChildren(row, std::move(nodes));
   endInsertRows();
+
+  CommandHistory::Delta d;
+  d.kind = CommandHistory::Delta::Kind::Insert;
+  d.parent = parentNode;
+  d.row = row;
+  d.count = count;
+  m_history.record(std::move(d));
+}
+
+std::vector<std::unique_ptr<CommandNode>> CommandModel::detachNodes(CommandNode* parentNode,
+                                                                    int row, int count) {
+  beginRemoveRows(indexFromNode(parentNode), row, row + count - 1);
+  for (int i = row; i < row + count; ++i) {
+    unindexSubtree(parentNode->child(i));
+  }
+  auto taken = parentNode->takeChildren(row, count);
+  endRemoveRows();
+  return taken;
+}
+
+void CommandModel::removeNodes(CommandNode* parentNode, int row, int count) {
+  auto taken = detachNodes(parentNode, row, count);
+  if (!m_history.isRecording()) return;
+
+  // the history keeps the removed rows alive for undo
+  CommandHistory::Delta d;
+  d.kind = CommandHistory::Delta::Kind::Remove;
+  d.parent = parentNode;
+  d.row = row;
+  d.count = count;
+  d.owned = std::move(taken);
+  m_history.record(std::move(d));
+}
+
+// Moves rows [first, first + count) of srcParent so that they start at
+// dstRow in dstParent, dstRow being the position after the move.
+bool CommandModel::relocateNodes(CommandNode* srcParent, int first, int count,
+                                 CommandNode* dstParent, int dstRow) {
+  const bool sameParent = (srcParent == dstParent);
+  if (sameParent && dstRow == first) return false;
+
+  // beginMoveRows wants the insertion point before the move
+  const int qtDest = (sameParent && dstRow > first) ? dstRow + count : dstRow;
+  if (!beginMoveRows(indexFromNode(srcParent), first, first + count - 1,
+                     indexFromNode(dstParent), qtDest)) {
+    return false;
+  }
+  if (sameParent) {
+    srcParent->moveChildren(first, count, dstRow);
+  } else {
+    dstParent->insertChildren(dstRow, srcParent->takeChildren(first, count));
+  }
+  endMoveRows();
+
+  CommandHistory::Delta d;
+  d.kind = CommandHistory::Delta::Kind::Move;
+  d.parent = srcParent;
+  d.row = first;
+  d.count = count;
+  d.dstParent = dstParent;
+  d.dstRow = dstRow;
+  m_history.record(std::move(d));
   return true;
 }
 
@@ -133,11 +365,7 @@ bool CommandModel::removeCommand(const QModelIndex& index) {
   if (isStartNode(n)) return false; // never remove Start
   CommandNode* p = n->parent();
   if (!p) return false;
-  const int r = n->row();
-
-  beginRemoveRows(parent(index), r, r);
-  (void)p->takeChild(r);
-  endRemoveRows();
+  removeNodes(p, n->row(), 1);
   return true;
 }
 
@@ -150,11 +378,7 @@ bool CommandModel::moveUp(const QModelIndex& index) {
   const int r = n->row();
   if (r <= 0) return false; // first among siblings
 
-  auto parentIdx = parent(index);
-  if (!beginMoveRows(parentIdx, r, r, parentIdx, r - 1)) return false;
-  p->moveChild(r, r - 1);
-  endMoveRows();
-  return true;
+  return relocateNodes(p, r, 1, p, r - 1);
 }
 
 bool CommandModel::moveDown(const QModelIndex& index) {
@@ -164,14 +388,11 @@ bool CommandModel::moveDown(const QModelIndex& index) {
   auto* p = n->parent();
   if (!p) return false;
   const int r = n->row();
+  if (r >= p->childCount() - 1) fetchPending(p, kFetchBatch);
   const int cnt = p->childCount();
   if (r >= cnt - 1) return false; // last among siblings
 
-  auto parentIdx = parent(index);
-  if (!beginMoveRows(parentIdx, r, r, parentIdx, r + 2)) return false;
-  p->moveChild(r, r + 1);
-  endMoveRows();
-  return true;
+  return relocateNodes(p, r, 1, p, r + 1);
 }
 
 bool CommandModel::moveInto(const QModelIndex& srcIdx,
@@ -192,23 +413,14 @@ bool CommandModel::moveInto(const QModelIndex& srcIdx,
   CommandNode* srcParent = srcNode->parent();
   if (!srcParent) return false;
 
+  fetchAllPending(dstParent);
   int srcRow = srcNode->row();
   int dstRow = (atRow < 0) ? dstParent->childCount() : atRow;
 
-  QModelIndex srcParentIdx = parent(srcIdx);
-  QModelIndex dstQParentIdx = dstParentIdx;
-
-  // Qt sẽ lo offset khi cùng parent, nhưng với thao tác dữ liệu ta cần chỉnh dstRow nếu cùng parent và kéo xuống
-  if (!beginMoveRows(srcParentIdx, srcRow, srcRow, dstQParentIdx, dstRow)) return false;
-
-  // Thực sự di chuyển trong cây
-  std::unique_ptr<CommandNode> moved = srcParent->takeChild(srcRow);
-
+  if (srcParent == dstParent && dstRow == srcRow + 1) return false; // no-op
   if (srcParent == dstParent && dstRow > srcRow) dstRow -= 1; // sau khi take ra, chỉ số dịch xuống
 
-  dstParent->insertChild(dstRow, std::move(moved));
-  endMoveRows();
-  return true;
+  return relocateNodes(srcParent, srcRow, 1, dstParent, dstRow);
 }
 
 bool CommandModel::moveToRoot(const QModelIndex& srcIdx, int atRow) {
@@ -222,10 +434,10 @@ bool CommandModel::moveToRoot(const QModelIndex& srcIdx, int atRow) {
   CommandNode* srcParent = srcNode->parent();
   if (!srcParent) return false; // đã ở root (parent==nullptr với root-invisible; srcParent==m_root.get() nghĩa là đang ở root)
 
+  fetchAllPending(m_root.get());
   int srcRow = srcNode->row();
 
-  // Đưa vào root (QModelIndex() là root)
-  QModelIndex rootIdx; // invalid = root
+  // Đưa vào root
   int dstRow;
   if (atRow < 0) {
     // chèn cuối root
@@ -237,38 +449,386 @@ bool CommandModel::moveToRoot(const QModelIndex& srcIdx, int atRow) {
   // Bảo toàn Start ở row 0: không chèn trước Start
   if (dstRow <= 0) dstRow = 1;
 
-  QModelIndex srcParentIdx = parent(srcIdx);
+  if (srcParent == m_root.get() && dstRow == srcRow + 1) return false; // no-op
+  // Nếu srcParent là root và đang kéo xuống sau vị trí cũ, cần chỉnh dstRow giảm 1.
+  if (srcParent == m_root.get() && dstRow > srcRow) dstRow -= 1;
 
-  // beginMoveRows dùng dstRow theo quy ước Qt (điểm chèn trước vị trí dstRow)
-  if (!beginMoveRows(srcParentIdx, srcRow, srcRow, rootIdx, dstRow)) return false;
+  return relocateNodes(srcParent, srcRow, 1, m_root.get(), dstRow);
+}
 
-  std::unique_ptr<CommandNode> moved = srcParent->takeChild(srcRow);
+// ---------------- Batch operations ----------------
+// Selections are reduced to their top-most nodes (a selected descendant moves
+// or dies with its selected ancestor), then grouped into runs of adjacent
+// siblings so every run costs a single begin/end notification pair.
 
-  // Nếu srcParent là root và đang kéo xuống sau vị trí cũ, cần chỉnh dstRow giảm 1.
-  if (srcParent == m_root.get() && dstRow > srcRow) dstRow -= 1;
+std::vector<CommandNode*> CommandModel::topLevelNodes(const QModelIndexList& indexes) const {
+  QSet<CommandNode*> selected;
+  for (const QModelIndex& idx : indexes) {
+    CommandNode* n = nodeFromIndex(idx);
+    if (n && idx.model() == this && !isStartNode(n)) selected.insert(n);
+  }
 
-  m_root->insertChild(dstRow, std::move(moved));
-  endMoveRows();
+  std::vector<CommandNode*> out;
+  out.reserve(selected.size());
+  for (CommandNode* n : std::as_const(selected)) {
+    bool covered = false;
+    for (CommandNode* p = n->parent(); p && !covered; p = p->parent()) {
+      covered = selected.contains(p);
+    }
+    if (!covered) out.push_back(n);
+  }
+
+  // program order, so runs come out sorted and moves keep the user's order
+  std::sort(out.begin(), out.end(), [this](CommandNode* a, CommandNode* b) {
+    return globalOrder(a, true) < globalOrder(b, true);
+  });
+  return out;
+}
+
+std::vector<std::vector<CommandNode*>> CommandModel::siblingRuns(const std::vector<CommandNode*>& nodes) {
+  std::vector<std::vector<CommandNode*>> runs;
+  for (CommandNode* n : nodes) {
+    if (!runs.empty()) {
+      CommandNode* prev = runs.back().back();
+      if (prev->parent() == n->parent() && prev->row() + 1 == n->row()) {
+        runs.back().push_back(n);
+        continue;
+      }
+    }
+    runs.push_back({n});
+  }
+  return runs;
+}
+
+static void appendCommands(const std::vector<CommandNode*>& run, std::vector<Command*>* out) {
+  if (!out) return;
+  for (CommandNode* n : run) out->push_back(n->command().get());
+}
+
+std::vector<Command*> CommandModel::removalTargets(const QModelIndexList& indexes) const {
+  std::vector<Command*> out;
+  appendCommands(topLevelNodes(indexes), &out);
+  return out;
+}
+
+bool CommandModel::removeCommands(const QModelIndexList& indexes) {
+  CommandHistory::Group group(m_history);
+  const auto runs = siblingRuns(topLevelNodes(indexes));
+  // back to front: earlier runs keep their rows while later ones go away
+  for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+    removeNodes(it->front()->parent(), it->front()->row(), static_cast<int>(it->size()));
+  }
+  return !runs.empty();
+}
+
+bool CommandModel::moveUp(const QModelIndexList& indexes, std::vector<Command*>* movedCommands) {
+  CommandHistory::Group group(m_history);
+  bool moved = false;
+  for (const auto& run : siblingRuns(topLevelNodes(indexes))) {
+    CommandNode* p = run.front()->parent();
+    const int first = run.front()->row();
+    const int last = first + static_cast<int>(run.size()) - 1;
+    const int minRow = (p == m_root.get() && hasStartNode()) ? 1 : 0;
+    if (first <= minRow) continue; // already on top (or right under Start)
+
+    if (relocateNodes(p, first, last - first + 1, p, first - 1)) {
+      appendCommands(run, movedCommands);
+      moved = true;
+    }
+  }
+  return moved;
+}
+
+bool CommandModel::moveDown(const QModelIndexList& indexes, std::vector<Command*>* movedCommands) {
+  CommandHistory::Group group(m_history);
+  bool moved = false;
+  const auto runs = siblingRuns(topLevelNodes(indexes));
+  for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+    CommandNode* p = it->front()->parent();
+    const int first = it->front()->row();
+    const int last = first + static_cast<int>(it->size()) - 1;
+    if (last >= p->childCount() - 1) fetchPending(p, kFetchBatch);
+    if (last >= p->childCount() - 1) continue; // already at the bottom
+
+    if (relocateNodes(p, first, last - first + 1, p, first + 1)) {
+      appendCommands(*it, movedCommands);
+      moved = true;
+    }
+  }
+  return moved;
+}
+
+bool CommandModel::moveInto(const QModelIndexList& indexes, const QModelIndex& dstParentIdx,
+                            int atRow, std::vector<Command*>* moved) {
+  auto* dstParent = nodeFromIndex(dstParentIdx);
+  if (!dstParent) return false;
+  if (dstParent->command() && !dstParent->command()->isAllowChild()) return false;
+  fetchAllPending(dstParent);
+  return moveNodes(topLevelNodes(indexes), dstParent,
+                   (atRow < 0) ? dstParent->childCount() : atRow, moved);
+}
+
+bool CommandModel::moveToRoot(const QModelIndexList& indexes, int atRow,
+                              std::vector<Command*>* moved) {
+  fetchAllPending(m_root.get());
+  int dstRow = (atRow < 0) ? m_root->childCount() : atRow;
+  if (dstRow <= 0) dstRow = 1; // Start stays at row 0
+  return moveNodes(topLevelNodes(indexes), m_root.get(), dstRow, moved);
+}
+
+// Moves `nodes` (top-level, in program order) so they end up contiguous
+// under dstParent starting at dstRow (a row in dstParent before the move).
+bool CommandModel::moveNodes(const std::vector<CommandNode*>& nodes,
+                             CommandNode* dstParent, int dstRow,
+                             std::vector<Command*>* movedCommands) {
+  // never move a node into itself or one of its descendants
+  for (CommandNode* n : nodes) {
+    for (CommandNode* p = dstParent; p; p = p->parent())
+      if (p == n) return false;
+  }
+
+  CommandHistory::Group group(m_history);
+  dstRow = std::clamp(dstRow, 0, dstParent->childCount());
+  bool moved = false;
+
+  for (const auto& run : siblingRuns(nodes)) {
+    CommandNode* srcParent = run.front()->parent();
+    const int first = run.front()->row();
+    const int count = static_cast<int>(run.size());
+    const int last = first + count - 1;
+
+    if (srcParent == dstParent && dstRow >= first && dstRow <= last + 1) {
+      dstRow = last + 1; // run already sits at the insertion point
+      continue;
+    }
+
+    if (srcParent == dstParent && dstRow > first) dstRow -= count;
+    if (!relocateNodes(srcParent, first, count, dstParent, dstRow)) continue;
+
+    appendCommands(run, movedCommands);
+    dstRow += count;
+    moved = true;
+  }
+  return moved;
+}
+
+// ---------------- Undo / redo ----------------
+
+bool CommandModel::editCommand(Command* cmd, const std::function<void(Command*)>& change) {
+  if (!cmd || !change) return false;
+  auto it = m_nodeByCommand.constFind(cmd);
+  if (it == m_nodeByCommand.constEnd()) return false;
+  CommandNode* node = it.value();
+
+  const int n = cmd->paramCount();
+  std::vector<double> before(n);
+  for (int i = 0; i < n; ++i) before[i] = cmd->param(i);
+
+  change(cmd);
+
+  CommandHistory::Delta d;
+  d.kind = CommandHistory::Delta::Kind::Edit;
+  d.node = node;
+  for (int i = 0; i < n; ++i) {
+    const double after = cmd->param(i);
+    if (after != before[i]) d.params.push_back({i, before[i], after});
+  }
+
+  emitParamsChanged(node);
+  if (!d.params.empty()) m_history.record(std::move(d));
   return true;
 }
 
-static CommandNode* findNodeByCommand(CommandNode* n, const rp::Command* c) {
-  if (!n) return nullptr;
-  if (n->command() && n->command().get() == c) return n;
-  for (int i = 0; i < n->childCount(); ++i) {
-    if (auto* hit = findNodeByCommand(n->child(i), c)) return hit;
+void CommandModel::undo() {
+  if (!m_history.canUndo()) return;
+  CommandHistory::Step step = m_history.takeUndo();
+  {
+    CommandHistory::Replay replay(m_history);
+    for (auto it = step.deltas.rbegin(); it != step.deltas.rend(); ++it) {
+      applyDelta(*it, false);
+    }
+  }
+  m_history.pushUndone(std::move(step));
+}
+
+void CommandModel::redo() {
+  if (!m_history.canRedo()) return;
+  CommandHistory::Step step = m_history.takeRedo();
+  {
+    CommandHistory::Replay replay(m_history);
+    for (CommandHistory::Delta& d : step.deltas) {
+      applyDelta(d, true);
+    }
+  }
+  m_history.pushRedone(std::move(step));
+}
+
+// Replays one delta; `forward` redoes it, otherwise it is reverted. Rows
+// leaving the tree are parked in the delta until they come back.
+void CommandModel::applyDelta(CommandHistory::Delta& d, bool forward) {
+  using Kind = CommandHistory::Delta::Kind;
+  switch (d.kind) {
+  case Kind::Insert:
+  case Kind::Remove:
+    if (forward == (d.kind == Kind::Insert)) {
+      attachNodes(d.parent, d.row, std::exchange(d.owned, {}));
+    } else {
+      d.owned = detachNodes(d.parent, d.row, d.count);
+    }
+    break;
+  case Kind::Move:
+    if (forward) {
+      relocateNodes(d.parent, d.row, d.count, d.dstParent, d.dstRow);
+    } else {
+      relocateNodes(d.dstParent, d.dstRow, d.count, d.parent, d.row);
+    }
+    break;
+  case Kind::Edit:
+    if (Command* c = d.node->command().get()) {
+      for (const auto& p : d.params) {
+        c->setParam(p.index, forward ? p.after : p.before);
+      }
+    }
+    emitParamsChanged(d.node);
+    break;
+  case Kind::BatchEdit: {
+    std::vector<CommandNode*> nodes;
+    nodes.reserve(d.edits.size());
+    for (const CommandHistory::RowEdit& e : d.edits) {
+      if (Command* c = e.node->command().get()) {
+        c->setParam(e.change.index, forward ? e.change.after : e.change.before);
+      }
+      nodes.push_back(e.node);
+    }
+    emitParamsChanged(std::move(nodes));
+    break;
   }
-  return nullptr;
+  }
+}
+
+void CommandModel::emitParamsChanged(CommandNode* node) {
+  const QModelIndex idx = indexFromNode(node);
+  if (idx.isValid()) emit dataChanged(idx, idx, {Qt::DisplayRole});
+}
+
+// One dataChanged() per run of adjacent rows under the same parent.
+void CommandModel::emitParamsChanged(std::vector<CommandNode*> nodes) {
+  std::vector<std::pair<CommandNode*, int>> rows; // (parent, row)
+  rows.reserve(nodes.size());
+  for (CommandNode* n : nodes) {
+    if (n->parent()) rows.emplace_back(n->parent(), n->row());
+  }
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  for (std::size_t i = 0; i < rows.size(); ) {
+    std::size_t j = i + 1;
+    while (j < rows.size() && rows[j].first == rows[i].first
+           && rows[j].second == rows[j - 1].second + 1) {
+      ++j;
+    }
+    const QModelIndex parentIdx = indexFromNode(rows[i].first);
+    emit dataChanged(index(rows[i].second, 0, parentIdx), index(rows[j - 1].second, 0, parentIdx),
+                     {Qt::DisplayRole});
+    i = j;
+  }
+}
+
+void CommandModel::setDiagnostics(CommandNode* node, int severity, const QStringList& messages) {
+  if (messages.isEmpty()) {
+    if (!m_diagnostics.remove(node)) return;
+  } else {
+    Diagnostics& d = m_diagnostics[node];
+    if (d.severity == severity && d.messages == messages) return;
+    d.severity = severity;
+    d.messages = messages;
+  }
+  const QModelIndex idx = indexFromNode(node);
+  if (idx.isValid()) emit dataChanged(idx, idx, {DiagnosticsRole, DiagnosticSeverityRole});
 }
 
 QModelIndex CommandModel::findIndexByCommand(const rp::Command* c) const {
   if (!c) return {};
-  // root’s children
-  for (int i = 0; i < m_root->childCount(); ++i) {
-    if (auto* hit = findNodeByCommand(m_root->child(i), c))
-      return indexFromNode(hit);
+  auto it = m_nodeByCommand.constFind(c);
+  return it == m_nodeByCommand.constEnd() ? QModelIndex() : indexFromNode(it.value());
+}
+
+QModelIndex CommandModel::findIndexById(quint64 id) const {
+  auto it = m_nodeById.constFind(id);
+  return it == m_nodeById.constEnd() ? QModelIndex() : indexFromNode(it.value());
+}
+
+QModelIndex CommandModel::findIndexByName(const QString& name) const {
+  const NameTable::Id id = NameTable::find(name);
+  if (id != NameTable::kNone) {
+    auto it = m_nodesByName.constFind(id);
+    if (it != m_nodesByName.constEnd()) return indexFromNode(it.value());
+  }
+  // generated "cmd_<id>" names are not indexed: resolve them through the id
+  const QLatin1String prefix("cmd_");
+  if (!name.startsWith(prefix)) return {};
+  bool ok = false;
+  const quint64 cmdId = QStringView(name).mid(prefix.size()).toULongLong(&ok);
+  if (!ok) return {};
+  auto it = m_nodeById.constFind(cmdId);
+  if (it == m_nodeById.constEnd()) return {};
+  const Command* c = it.value()->command().get();
+  return c && c->commandName() == name ? indexFromNode(it.value()) : QModelIndex();
+}
+
+bool CommandModel::renameCommand(Command* cmd, const QString& name) {
+  auto it = m_nodeByCommand.constFind(cmd);
+  if (it == m_nodeByCommand.constEnd()) return false;
+  cmd->setCommandName(name);
+  const QModelIndex idx = indexFromNode(it.value());
+  emit dataChanged(idx, idx, {Qt::DisplayRole}); // reindexes the name
+  return true;
+}
+
+// Keep the lookup tables in sync: every node entering the tree is indexed
+// with its whole subtree, every node leaving it is dropped the same way.
+void CommandModel::indexSubtree(CommandNode* n) {
+  if (!n) return;
+  if (n->command()) {
+    m_nodeByCommand.insert(n->command().get(), n);
+    m_nodeById.insert(n->command()->id(), n);
+    indexName(n);
+  }
+  if (n->hasPendingChildren()) m_pendingNodes.insert(n);
+  for (int i = 0; i < n->childCount(); ++i) {
+    indexSubtree(n->child(i));
   }
-  return {};
+}
+
+void CommandModel::unindexSubtree(CommandNode* n) {
+  if (!n) return;
+  if (n->command()) {
+    m_nodeByCommand.remove(n->command().get());
+    m_nodeById.remove(n->command()->id());
+    unindexName(n);
+  }
+  m_diagnostics.remove(n);
+  m_pendingNodes.remove(n);
+  for (int i = 0; i < n->childCount(); ++i) {
+    unindexSubtree(n->child(i));
+  }
+}
+
+// Moves `n` to the bucket of its current custom name, if that changed.
+void CommandModel::indexName(CommandNode* n) {
+  const Command* c = n->command().get();
+  const NameTable::Id id = c ? c->nameId() : NameTable::kNone;
+  if (m_nameOf.value(n, NameTable::kNone) == id) return;
+  unindexName(n);
+  if (id == NameTable::kNone) return;
+  m_nameOf.insert(n, id);
+  m_nodesByName.insert(id, n);
+}
+
+void CommandModel::unindexName(CommandNode* n) {
+  auto it = m_nameOf.find(n);
+  if (it == m_nameOf.end()) return;
+  m_nodesByName.remove(it.value(), n);
+  m_nameOf.erase(it);
 }
 
 Command* CommandModel::commandFromIndex(const QModelIndex& idx) const {
@@ -333,30 +893,127 @@ int CommandModel::globalOrder(const QModelIndex& idx, bool includeStart) const {
 //   return order;
 // }
 
+// Pre-order position from the cached subtree sizes: walk up to the root and
+// add each ancestor's offset among its siblings, O(depth).
 int CommandModel::globalOrder(rp::CommandNode* target, bool includeStart) const {
-  if (!target) return -1;
+  if (!target || target == m_root.get()) return -1;
 
   int order = 0;
-  int result = -1;
+  CommandNode* n = target;
+  for (; n->parent(); n = n->parent()) {
+    order += n->preorderOffset();
+    if (n->parent() != m_root.get()) order += 1; // the parent itself
+  }
+  if (n != m_root.get()) return -1; // detached node
 
-  std::function<void(CommandNode*)> dfs = [&](CommandNode* n){
-    if (!n) return;
+  if (!includeStart && hasStartNode()) {
+    if (isStartNode(target)) return -1;
+    order -= 1;
+  }
+  return order;
+}
 
-    if (n != m_root.get()) {
-      bool isStartN = isStartNode(n);
-      bool countThis = includeStart || !isStartN;
-      if (countThis) {
-        if (n == target) { result = order; /* không return ngay để dễ đọc */ }
-        ++order;
-      }
-    }
-    for (int i = 0; i < n->childCount(); ++i) {
-      dfs(n->child(i));
+// Subtree sizes count pending rows, so the descent is exact; a position
+// inside a pending tail fetches that parent's rows up to it.
+QModelIndex CommandModel::indexAtGlobalOrder(int order, bool includeStart) {
+  if (!includeStart && hasStartNode()) order += 1;
+  if (order < 0 || order >= m_root->subtreeSize() - 1) return {};
+
+  CommandNode* n = m_root.get();
+  for (;;) {
+    CommandNode* c = n->childAtPreorderOffset(order);
+    while (!c && n->hasPendingChildren()) {
+      fetchPending(n, kFetchBatch);
+      c = n->childAtPreorderOffset(order);
     }
-  };
+    if (!c) return {};
+    order -= c->preorderOffset();
+    if (order == 0) return indexFromNode(c);
+    order -= 1; // step over c, continue inside its children
+    n = c;
+  }
+}
+
+const FlatCommandTree& CommandModel::flatTree() const {
+  if (m_flatRevision != m_structureRevision) {
+    m_flat.build(m_root.get());
+    m_flatRevision = m_structureRevision;
+  }
+  return m_flat;
+}
+
+const MoveLArrays& CommandModel::moveLArrays() {
+  // fetching bumps the structure revision, so the arrays are rebuilt below
+  fetchAll(QModelIndex(), /*recursive=*/true);
+  if (m_moveLRevision != m_structureRevision) {
+    m_moveL.build(flatTree());
+    m_moveLRevision = m_structureRevision;
+  } else {
+    for (const Command* c : std::as_const(m_moveLEdited)) m_moveL.update(c);
+  }
+  m_moveLEdited.clear();
+  return m_moveL;
+}
+
+int CommandModel::clampMoveLSpeeds(double lo, double hi) {
+  const MoveLArrays& arrays = moveLArrays();
+  std::vector<double> speeds(arrays.speed(), arrays.speed() + arrays.size());
+  if (movel::clampSpeeds(speeds.data(), speeds.size(), lo, hi) == 0) return 0;
+
+  CommandHistory::Delta d;
+  d.kind = CommandHistory::Delta::Kind::BatchEdit;
+  std::vector<CommandNode*> nodes;
+  for (int i = 0; i < arrays.size(); ++i) {
+    const double before = arrays.speed()[i];
+    if (speeds[i] == before) continue;
+    Command* cmd = arrays.command(i);
+    CommandNode* node = m_nodeByCommand.value(cmd);
+    if (!node) continue;
+    d.edits.push_back({node, {3, before, speeds[i]}});
+    nodes.push_back(node);
+  }
+  for (const CommandHistory::RowEdit& e : d.edits) {
+    e.node->command()->setParam(3, e.change.after);
+  }
+  // dataChanged() patches the arrays on their next use
+  emitParamsChanged(std::move(nodes));
+  const int changed = static_cast<int>(d.edits.size());
+  if (changed > 0) m_history.record(std::move(d));
+  return changed;
+}
+
+ProgramSnapshotPtr CommandModel::snapshot() const {
+  if (m_snapshot && m_snapshot->structureRevision() == m_structureRevision
+      && m_snapshot->dataRevision() == m_dataRevision) {
+    return m_snapshot;
+  }
+
+  const FlatCommandTree& flat = flatTree();
+  const int n = flat.size();
+
+  // topology only changes with the structure revision
+  if (!m_snapshot || m_snapshot->structureRevision() != m_structureRevision) {
+    auto topo = std::make_shared<ProgramSnapshot::Topology>();
+    topo->parent = flat.parents();
+    topo->depth = flat.depths();
+    topo->subtreeSize.resize(n);
+    for (int i = 0; i < n; ++i) topo->subtreeSize[i] = flat.subtreeSize(i);
+    m_snapshotTopology = std::move(topo);
+  }
+
+  std::vector<std::shared_ptr<const Command>> commands;
+  commands.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    commands.push_back(flat.node(i)->frozenCommand());
+  }
+
+  m_snapshot = std::make_shared<const ProgramSnapshot>(m_structureRevision, m_dataRevision,
+                                                       m_snapshotTopology, std::move(commands));
+  return m_snapshot;
+}
 
-  dfs(m_root.get());
-  return result;
+bool CommandModel::hasStartNode() const {
+  return isStartNode(m_root->child(0));
 }
 
 bool CommandModel::isStartNode(const CommandNode* n) const {
@@ -2,8 +2,17 @@
 #define COMMANDMODEL_H
 
 #include <QAbstractItemModel>
+#include <QHash>
+#include <QMultiHash>
+#include <QSet>
+#include <QStringList>
+#include <functional>
 #include <memory>
+#include "commandhistory.h"
 #include "commandnode.h"
+#include "flatcommandtree.h"
+#include "movelarrays.h"
+#include "programsnapshot.h"
 
 namespace rp {
 
@@ -12,6 +21,27 @@ class CommandModel : public QAbstractItemModel {
 public:
   enum Column { ColMain = 0, ColCount = 1 }; // single column
 
+  // Subtree totals (see NodeAggregate), cached on the blocks
+  enum Role {
+    MoveCountRole = Qt::UserRole + 1, // int
+    PathLengthRole,                   // double, mm
+    EstimatedTimeRole,                // double, s
+    // Findings of the ProgramValidator for this row
+    DiagnosticsRole,                  // QStringList
+    DiagnosticSeverityRole            // int, see Severity
+  };
+
+  enum Severity { NoIssue = 0, Warning = 1, Error = 2 };
+
+  // True if a dataChanged() only carries diagnostics: the command itself did
+  // not change.
+  static bool isDiagnosticsOnly(const QList<int>& roles) {
+    for (int r : roles) {
+      if (r != DiagnosticsRole && r != DiagnosticSeverityRole) return false;
+    }
+    return !roles.isEmpty();
+  }
+
   explicit CommandModel(QObject* parent = nullptr);
   ~CommandModel() override;
 
@@ -23,9 +53,29 @@ public:
   QVariant data(const QModelIndex& index, int role) const override;
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
+  // Lazy population: rows behind a ChildSource become nodes in batches when
+  // the view asks for them (expanding a block, scrolling to the end).
+  bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+  bool canFetchMore(const QModelIndex& parent) const override;
+  void fetchMore(const QModelIndex& parent) override;
+
+  bool setChildSource(const QModelIndex& parentIdx, std::unique_ptr<ChildSource> source);
+  // Replaces the whole program with Start plus the rows of `topLevel`
+  // (fetched lazily). The undo history is cleared.
+  void resetProgram(std::unique_ptr<ChildSource> topLevel = nullptr);
+  // Materializes everything pending under parentIdx (whole subtree if
+  // recursive). Needed before flatTree()/snapshot() if they must be complete.
+  // Cheap when nothing is pending: only nodes that still have a source are
+  // visited.
+  void fetchAll(const QModelIndex& parentIdx, bool recursive = false);
+  // True while some row of the program is still behind a ChildSource.
+  bool hasPendingRows() const { return !m_pendingNodes.isEmpty(); }
+
   // API for view/controller
   bool insertSiblingAbove(const QModelIndex& ref, CommandPtr cmd);
   bool insertChild(const QModelIndex& parentIndex, CommandPtr cmd, int atRow = -1);
+  bool insertCommands(const QModelIndex& parentIndex, int atRow,
+                      const std::vector<CommandPtr>& cmds);
   bool removeCommand(const QModelIndex& index);
   bool moveUp(const QModelIndex& index);
   bool moveDown(const QModelIndex& index);
@@ -33,19 +83,134 @@ public:
                 int atRow = -1);
   bool moveToRoot(const QModelIndex& srcIdx, int atRow = -1);
 
+  // Multi-selection variants: rows are grouped into contiguous sibling runs,
+  // one begin/end notification pair per run. The moves append the commands
+  // they actually relocated to `moved`; runs that can't move or already sit
+  // at the destination are left out.
+  bool removeCommands(const QModelIndexList& indexes);
+  // What removeCommands(indexes) removes: the selected commands that are not
+  // Start or inside another selected block, in program order.
+  std::vector<Command*> removalTargets(const QModelIndexList& indexes) const;
+  bool moveUp(const QModelIndexList& indexes, std::vector<Command*>* moved = nullptr);
+  bool moveDown(const QModelIndexList& indexes, std::vector<Command*>* moved = nullptr);
+  bool moveInto(const QModelIndexList& indexes, const QModelIndex& dstParentIdx,
+                int atRow = -1, std::vector<Command*>* moved = nullptr);
+  bool moveToRoot(const QModelIndexList& indexes, int atRow = -1,
+                  std::vector<Command*>* moved = nullptr);
+
+  // Parameter edit through the undo history: `change` mutates the command,
+  // the numeric parameters that differ afterwards are recorded and
+  // dataChanged is emitted for its row.
+  bool editCommand(Command* cmd, const std::function<void(Command*)>& change);
+
+  // Stores the validator's findings for a row (empty messages clears them)
+  // and emits dataChanged() with the diagnostics roles only.
+  void setDiagnostics(CommandNode* node, int severity, const QStringList& messages);
+
+  // Undo/redo of every structural change and editCommand() call
+  bool canUndo() const { return m_history.canUndo(); }
+  bool canRedo() const { return m_history.canRedo(); }
+  CommandHistory& history() { return m_history; }
+
+public slots:
+  void undo();
+  void redo();
+
+signals:
+  void historyChanged();
+
+public:
 
   QModelIndex findIndexByCommand(const Command* c) const;
+  // O(1) lookups for references between commands (e.g. a jump to a label).
+  // By name: one of the rows with that custom name, if any; a generated
+  // "cmd_<id>" name finds its command through the id.
+  QModelIndex findIndexById(quint64 id) const;
+  QModelIndex findIndexByName(const QString& name) const;
+  // Renames a row and keeps the name index current (emits dataChanged).
+  bool renameCommand(Command* cmd, const QString& name);
   Command* commandFromIndex(const QModelIndex& idx) const;
   CommandNode* nodeFromIndex(const QModelIndex& idx) const;
+  // Invisible parent of the top-level rows (and owner of their ChildSource).
+  CommandNode* rootNode() const { return m_root.get(); }
   QModelIndex indexFromNode(CommandNode* node, int column = 0) const;
 
   int globalOrder(const QModelIndex& idx, bool includeStart = false) const;
   int globalOrder(CommandNode* node, bool includeStart = false) const;
+  // Fetches the pending rows it has to step into.
+  QModelIndex indexAtGlobalOrder(int order, bool includeStart = false);
 
   bool isStartNode(const CommandNode* n) const;
 
+  // Totals of the whole program, pending rows included.
+  NodeAggregate programAggregate() const { return m_root->aggregate(); }
+
+  // Pre-order structure-of-arrays view of the whole program, rebuilt on
+  // first use after a structural change. Use it for whole-program scans.
+  // Rows still pending in a ChildSource are not included.
+  const FlatCommandTree& flatTree() const;
+  // MoveL targets of the whole program as contiguous arrays for the movel::
+  // kernels. Fetches rows still pending in a ChildSource first.
+  const MoveLArrays& moveLArrays();
+  // Clamps every MoveL speed into [lo, hi] as one undoable edit, pending
+  // rows included; returns the number of commands changed. Changed rows are
+  // announced as one dataChanged() per run of adjacent siblings.
+  int clampMoveLSpeeds(double lo, double hi);
+  quint64 structureRevision() const { return m_structureRevision; }
+  quint64 dataRevision() const { return m_dataRevision; }
+
+  // Immutable copy of the program for worker threads. Cheap when nothing
+  // changed (same object is returned) and proportional to the number of
+  // rows plus edited commands otherwise. GUI thread only; the result may be
+  // read and released from any thread.
+  ProgramSnapshotPtr snapshot() const;
+
 private:
+  bool hasStartNode() const;
+  void attachNodes(CommandNode* parentNode, int row,
+                   std::vector<std::unique_ptr<CommandNode>> nodes);
+  std::vector<std::unique_ptr<CommandNode>> detachNodes(CommandNode* parentNode, int row, int count);
+  void removeNodes(CommandNode* parentNode, int row, int count);
+  bool relocateNodes(CommandNode* srcParent, int first, int count,
+                     CommandNode* dstParent, int dstRow);
+  void applyDelta(CommandHistory::Delta& d, bool forward);
+  void fetchPending(CommandNode* node, int max);
+  void fetchAllPending(CommandNode* node);
+  void emitParamsChanged(CommandNode* node);
+  void emitParamsChanged(std::vector<CommandNode*> nodes);
+  std::vector<CommandNode*> topLevelNodes(const QModelIndexList& indexes) const;
+  static std::vector<std::vector<CommandNode*>> siblingRuns(const std::vector<CommandNode*>& nodes);
+  bool moveNodes(const std::vector<CommandNode*>& nodes, CommandNode* dstParent, int dstRow,
+                 std::vector<Command*>* moved);
+  void indexSubtree(CommandNode* n);
+  void unindexSubtree(CommandNode* n);
+  void indexName(CommandNode* n);
+  void unindexName(CommandNode* n);
+
+  static constexpr int kFetchBatch = 256; // rows materialized per fetchMore()
+
   std::unique_ptr<CommandNode> m_root; // invisible root
+  QHash<const Command*, CommandNode*> m_nodeByCommand; // O(1) findIndexByCommand
+  QHash<quint64, CommandNode*> m_nodeById;
+  QMultiHash<NameTable::Id, CommandNode*> m_nodesByName; // custom names only
+  QHash<const CommandNode*, NameTable::Id> m_nameOf;     // name each node is indexed under
+  QSet<CommandNode*> m_pendingNodes; // nodes in the tree with a non-empty ChildSource
+  quint64 m_structureRevision {1};
+  mutable quint64 m_flatRevision {0};
+  mutable FlatCommandTree m_flat;
+  mutable quint64 m_moveLRevision {0};
+  mutable MoveLArrays m_moveL;
+  mutable QSet<const Command*> m_moveLEdited; // to patch on next access
+  quint64 m_dataRevision {1};
+  mutable ProgramSnapshotPtr m_snapshot;
+  mutable std::shared_ptr<const ProgramSnapshot::Topology> m_snapshotTopology;
+  CommandHistory m_history;
+
+  struct Diagnostics {
+    int severity {NoIssue};
+    QStringList messages;
+  };
+  QHash<const CommandNode*, Diagnostics> m_diagnostics; // rows with findings only
 };
 }
 
@@ -1,9 +1,14 @@
 #ifndef COMMANDNODE_H
 #define COMMANDNODE_H
 
+#include "childsource.h"
 #include "command.h"
+#include "nodeaggregate.h"
+#include "slabpool.h"
 #include <vector>
 #include <memory>
+#include <limits>
+#include <algorithm>
 
 namespace rp {
 
@@ -14,6 +19,18 @@ public:
 
   }
 
+  // Nodes come from a slab pool: loading or pasting large programs would
+  // otherwise be dominated by one malloc per row.
+  static void* operator new(std::size_t size) {
+    if (size != sizeof(CommandNode)) return ::operator new(size);
+    return slabPoolFor<sizeof(CommandNode), alignof(CommandNode)>().allocate();
+  }
+
+  static void operator delete(void* p, std::size_t size) noexcept {
+    if (size != sizeof(CommandNode)) { ::operator delete(p); return; }
+    slabPoolFor<sizeof(CommandNode), alignof(CommandNode)>().deallocate(p);
+  }
+
   CommandNode* parent() const {
     return m_parent;
   }
@@ -26,16 +43,65 @@ public:
     return (row >= 0 && row < childCount()) ? m_children[row].get() : nullptr;
   }
 
+  // O(1) amortized: every node keeps its own index among siblings. Edits only
+  // mark the parent stale from the first touched row, the suffix is renumbered
+  // on the next lookup that falls into it.
   int row() const {
     if (!m_parent) {
       return 0;
     }
+    if (m_row >= m_parent->m_staleFrom) {
+      m_parent->renumberChildren();
+    }
+    return m_row;
+  }
 
-    for (int i = 0; i < m_parent->childCount(); ++i) {
-      if (m_parent->m_children[i].get() == this) return i;
+  // Number of nodes in this subtree, this node included, pending rows at any
+  // depth too.
+  int subtreeSize() const {
+    return m_subtreeSize;
+  }
+
+  // Pre-order position of this node among everything under its parent, i.e.
+  // the summed subtree sizes of the siblings before it.
+  int preorderOffset() const {
+    if (!m_parent) {
+      return 0;
+    }
+    if (m_row >= m_parent->m_staleFrom) {
+      m_parent->renumberChildren();
     }
+    return m_offset;
+  }
+
+  // Child whose subtree covers pre-order position `offset` (relative to the
+  // first child), found by binary search over the cached offsets.
+  // Offsets inside the pending rows after the last child give nullptr.
+  CommandNode* childAtPreorderOffset(int offset) const {
+    if (offset < 0 || offset >= m_subtreeSize - 1 - pendingNodeCount()) {
+      return nullptr;
+    }
+    if (m_staleFrom != kClean) {
+      renumberChildren();
+    }
+    auto it = std::upper_bound(m_children.begin(), m_children.end(), offset,
+                               [](int off, const std::unique_ptr<CommandNode>& c) {
+                                 return off < c->m_offset;
+                               });
+    return (it == m_children.begin()) ? nullptr : std::prev(it)->get();
+  }
 
-    return 0;
+  // Next node in depth-first pre-order, nullptr after the last one.
+  CommandNode* nextInPreorder() const {
+    if (!m_children.empty()) {
+      return m_children.front().get();
+    }
+    for (const CommandNode* n = this; n->m_parent; n = n->m_parent) {
+      if (CommandNode* sibling = n->m_parent->child(n->row() + 1)) {
+        return sibling;
+      }
+    }
+    return nullptr;
   }
 
   void insertChild(int row, std::unique_ptr<CommandNode> node) {
@@ -47,7 +113,34 @@ public:
       row = childCount();
     }
     node->m_parent = this;
+    node->m_row = row;
+    const int added = node->m_subtreeSize;
     m_children.insert(m_children.begin() + row, std::move(node));
+    markStaleFrom(row);
+    markChildrenChanged();
+    addToSubtreeSize(added);
+  }
+
+  // Inserts a contiguous block with a single vector shift.
+  void insertChildren(int row, std::vector<std::unique_ptr<CommandNode>> nodes) {
+    if (nodes.empty()) {
+      return;
+    }
+    if (row < 0 || row > childCount()) {
+      row = childCount();
+    }
+    int added = 0;
+    for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
+      nodes[i]->m_parent = this;
+      nodes[i]->m_row = row + i;
+      added += nodes[i]->m_subtreeSize;
+    }
+    m_children.insert(m_children.begin() + row,
+                      std::make_move_iterator(nodes.begin()),
+                      std::make_move_iterator(nodes.end()));
+    markStaleFrom(row);
+    markChildrenChanged();
+    addToSubtreeSize(added);
   }
 
   void appendChild(std::unique_ptr<CommandNode> node) {
@@ -55,7 +148,12 @@ public:
       return;
     }
     node->m_parent = this;
+    node->m_row = childCount();
+    const int added = node->m_subtreeSize;
     m_children.emplace_back(std::move(node));
+    markStaleFrom(childCount() - 1);
+    markChildrenChanged();
+    addToSubtreeSize(added);
   }
 
   std::unique_ptr<CommandNode> takeChild(int row) {
@@ -65,9 +163,52 @@ public:
     std::unique_ptr<CommandNode> n = std::move(m_children[row]);
     m_children.erase(m_children.begin() + row);
     n->m_parent = nullptr;
+    n->m_row = 0;
+    markStaleFrom(row);
+    markChildrenChanged();
+    addToSubtreeSize(-n->m_subtreeSize);
     return n;
   }
 
+  // Removes `count` rows starting at `row` with a single vector shift.
+  std::vector<std::unique_ptr<CommandNode>> takeChildren(int row, int count) {
+    std::vector<std::unique_ptr<CommandNode>> out;
+    if (row < 0 || count <= 0 || row + count > childCount()) {
+      return out;
+    }
+    out.reserve(count);
+    int removed = 0;
+    for (int i = row; i < row + count; ++i) {
+      auto& n = m_children[i];
+      n->m_parent = nullptr;
+      n->m_row = 0;
+      removed += n->m_subtreeSize;
+      out.push_back(std::move(n));
+    }
+    m_children.erase(m_children.begin() + row, m_children.begin() + row + count);
+    markStaleFrom(row);
+    markChildrenChanged();
+    addToSubtreeSize(-removed);
+    return out;
+  }
+
+  // Moves the block [from, from + count) so that it starts at row `to`
+  // (a row in the final order).
+  bool moveChildren(int from, int count, int to) {
+    if (count <= 0 || from < 0 || from + count > childCount()) return false;
+    if (to < 0 || to + count > childCount()) return false;
+    if (from == to) return true;
+    auto first = m_children.begin();
+    if (to < from) {
+      std::rotate(first + to, first + from, first + from + count);
+    } else {
+      std::rotate(first + from, first + from + count, first + to + count);
+    }
+    markStaleFrom(std::min(from, to));
+    markChildrenChanged();
+    return true;
+  }
+
   bool moveChild(int from, int to) {
     if (from == to) {
       return true;
@@ -77,21 +218,206 @@ public:
     auto node = std::move(m_children[from]);
     m_children.erase(m_children.begin() + from);
     m_children.insert(m_children.begin() + to, std::move(node));
+    markStaleFrom(std::min(from, to));
+    markChildrenChanged();
     return true;
   }
 
+  // Children that are not nodes yet (see ChildSource). They come after the
+  // materialized children and are not part of childCount(), but their nodes
+  // count in subtreeSize() and their totals in aggregate().
+  void setChildSource(std::unique_ptr<ChildSource> source) {
+    const int before = pendingNodeCount();
+    m_source = std::move(source);
+    markAggregateDirty(); // the pending rows are part of the block's own total
+    addToSubtreeSize(pendingNodeCount() - before);
+  }
+
+  const ChildSource* childSource() const {
+    return m_source.get();
+  }
+
+  bool hasPendingChildren() const {
+    return m_source && m_source->remaining() > 0;
+  }
+
+  int pendingChildCount() const {
+    return m_source ? m_source->remaining() : 0;
+  }
+
+  // Pending nodes at any depth below the pending children included.
+  int pendingNodeCount() const {
+    return m_source ? m_source->remainingNodes() : 0;
+  }
+
+  // Next `max` pending children; the caller inserts them at the end, which
+  // adds their subtrees back to subtreeSize().
+  std::vector<std::unique_ptr<CommandNode>> takePending(int max) {
+    if (!m_source) {
+      return {};
+    }
+    const int before = m_source->remainingNodes();
+    auto out = m_source->take(max);
+    const int after = m_source->remainingNodes();
+    if (m_source->remaining() == 0) {
+      m_source.reset();
+    }
+    markAggregateDirty(); // the pending rows are part of the block's own total
+    addToSubtreeSize(after - before);
+    return out;
+  }
+
   CommandPtr& command() {
     return m_cmd;
   }
 
+  // Immutable clone of the command for snapshots, made on first request and
+  // kept until the command is edited (see invalidateFrozen()).
+  const std::shared_ptr<const Command>& frozenCommand() {
+    if (!m_frozen && m_cmd) {
+      m_frozen = m_cmd->clone();
+    }
+    return m_frozen;
+  }
+
+  void invalidateFrozen() {
+    m_frozen.reset();
+  }
+
+  // Subtree totals. A row without children is computed from its command;
+  // a block caches its totals (see Block), rebuilt on demand from the
+  // children and the pending rows after them.
+  NodeAggregate aggregate() const {
+    if (m_children.empty() && !m_source) {
+      return NodeAggregate::of(m_cmd.get());
+    }
+    if (!m_block) {
+      m_block = std::make_unique<Block>();
+    }
+    if (m_block->dirty) {
+      NodeAggregate total = NodeAggregate::of(m_cmd.get());
+      total.append(m_block->children.total(childCount(), [this](int r) {
+        return m_children[r]->aggregate();
+      }));
+      if (m_source) {
+        total.append(m_source->remainingAggregate());
+      }
+      m_block->total = total;
+      m_block->dirty = false;
+    }
+    return m_block->total;
+  }
+
+  // After a parameter edit of this row.
+  void markAggregateDirty() {
+    if (m_block) {
+      m_block->dirty = true;
+    }
+    m_textStamp = 0;
+    propagateAggregateChange();
+  }
+
+  // Identifies the current text of the row (command text plus totals):
+  // views cache formatted titles under it. A new stamp is drawn after every
+  // change of the row or its subtree, and stamps are never reused, not even
+  // by another node at the same address. GUI thread only.
+  quint64 textStamp() const {
+    if (m_textStamp == 0) {
+      static quint64 s_next = 0;
+      aggregate(); // clean totals are what lets propagateAggregateChange() stop early
+      m_textStamp = ++s_next;
+    }
+    return m_textStamp;
+  }
+
   const CommandPtr& command() const {
     return m_cmd;
   }
 
 private:
+  static constexpr int kClean = std::numeric_limits<int>::max();
+
+  // Children in [from, end) may carry a stale m_row/m_offset. A stale m_row is
+  // never smaller than m_staleFrom, so row() can tell whether it must renumber.
+  void markStaleFrom(int from) {
+    if (from < m_staleFrom) {
+      m_staleFrom = from;
+    }
+  }
+
+  void renumberChildren() const {
+    const int n = childCount();
+    int offset = 0;
+    if (m_staleFrom > 0 && m_staleFrom < n) {
+      const CommandNode* prev = m_children[m_staleFrom - 1].get();
+      offset = prev->m_offset + prev->m_subtreeSize;
+    }
+    for (int i = m_staleFrom; i < n; ++i) {
+      m_children[i]->m_row = i;
+      m_children[i]->m_offset = offset;
+      offset += m_children[i]->m_subtreeSize;
+    }
+    m_staleFrom = kClean;
+  }
+
+  // Children were inserted, removed or reordered.
+  void markChildrenChanged() {
+    if (m_block) {
+      m_block->children.invalidateAll();
+      m_block->dirty = true;
+    }
+    m_textStamp = 0;
+    propagateAggregateChange();
+  }
+
+  // Marks the chunk holding each ancestor's changed child stale, up to the
+  // first chunk that was stale already: a stale chunk never sits below clean
+  // totals. An ancestor without a Block has never computed totals that
+  // include its children, so nothing above it needs marking either.
+  void propagateAggregateChange() {
+    for (CommandNode* n = this; n->m_parent; n = n->m_parent) {
+      CommandNode* p = n->m_parent;
+      if (!p->m_block) {
+        return;
+      }
+      if (p->m_block->children.invalidate(n->row())) {
+        return;
+      }
+      p->m_block->dirty = true;
+      p->m_textStamp = 0;
+    }
+  }
+
+  // Subtree sizes change along the ancestor chain; each ancestor's later
+  // siblings get their offsets invalidated (not recomputed) on the way up.
+  void addToSubtreeSize(int delta) {
+    for (CommandNode* n = this; n; n = n->m_parent) {
+      n->m_subtreeSize += delta;
+      if (n->m_parent) {
+        n->m_parent->markStaleFrom(n->m_row);
+      }
+    }
+  }
+
   CommandNode* m_parent;
   std::vector<std::unique_ptr<CommandNode>> m_children;
   CommandPtr m_cmd; // nullptr allowed on the invisible root
+  std::shared_ptr<const Command> m_frozen; // snapshot copy of m_cmd, if any
+  std::unique_ptr<ChildSource> m_source;   // children not materialized yet
+  mutable int m_row {0};              // index in m_parent->m_children
+  mutable int m_offset {0};           // pre-order offset among siblings
+  int m_subtreeSize {1};              // this node + all descendants, pending too
+  mutable int m_staleFrom {kClean};   // first child row whose m_row may be stale
+  mutable quint64 m_textStamp {0};    // 0 = not drawn yet or text changed
+
+  // Cached totals, only on rows that have had children or pending rows when
+  // asked for them: leaves are the vast majority and cheap to recompute.
+  struct Block {
+    NodeAggregate total;          // own command, children, pending rows
+    ChildAggregateTree children;
+    bool dirty {true};
+  };
+  mutable std::unique_ptr<Block> m_block;
 };
 }
 
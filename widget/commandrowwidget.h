@@ -19,6 +19,10 @@
 
 namespace rp {
 
+// What a click on a row asks for; RowDelegate and CommandRowWidget both
+// report it through a single rowAction() signal.
+enum class RowAction { MoveUp, MoveDown, Delete, Click };
+
 class CommandRowWidget : public QWidget {
   Q_OBJECT
 public:
@@ -41,6 +45,10 @@ public:
     lblTitle = new QLabel("", this);
     // lblTitle->setTextElideMode(Qt::ElideRight);
 
+    /// validation icon, hidden while the row has no findings
+    lblDiag = new QLabel(this);
+    lblDiag->setVisible(false);
+
     btnUp   = new QPushButton(this);
     btnDown = new QPushButton(this);
     btnDel  = new QPushButton(this);
@@ -58,26 +66,29 @@ public:
     btnDel->setToolTip("Delete");
 
     h->addWidget(lblOrder, 0, Qt::AlignVCenter);
+    h->addWidget(lblDiag, 0, Qt::AlignVCenter);
     h->addWidget(lblTitle, 1);    // stretch largest here
     h->addWidget(btnUp,   0);
     h->addWidget(btnDown, 0);
     h->addWidget(btnDel,  0);
-    h->setStretch(1, 1); // ensure title/info label stretches the most
+    h->setStretch(2, 1); // ensure title/info label stretches the most
 
     connect(btnUp,   &QPushButton::clicked, this, [this]{
-      emit requestUp(currentIndex);
+      emit rowAction(currentIndex, RowAction::MoveUp);
     });
     connect(btnDown, &QPushButton::clicked, this, [this]{
-      emit requestDown(currentIndex);
+      emit rowAction(currentIndex, RowAction::MoveDown);
     });
     connect(btnDel,  &QPushButton::clicked, this, [this]{
-      emit requestDelete(currentIndex);
+      emit rowAction(currentIndex, RowAction::Delete);
     });
 
     // Clicking anywhere on the title selects/announces command
     lblTitle->installEventFilter(this);
   }
 
+  const QModelIndex& index() const { return currentIndex; }
+
   void setContext(const QModelIndex& idx, CommandModel* model) {
     currentIndex = idx;
     m_model = model;
@@ -89,40 +100,100 @@ public:
       return;
     }
 
-    auto* node = static_cast<rp::CommandNode*>(currentIndex.internalPointer());
-    bool isStart = m_model->isStartNode(node);
+    // QLabel::setText() relayouts even for the same text: only format and
+    // set what changed
+    const int order = orderNumber(m_model, currentIndex);
+    if (order != m_shownOrder) {
+      lblOrder->setText(QString::number(order));
+      m_shownOrder = order;
+    }
+    const quint64 stamp = static_cast<CommandNode*>(currentIndex.internalPointer())->textStamp();
+    if (stamp != m_shownStamp) {
+      lblTitle->setText(titleText(m_model, currentIndex));
+      m_shownStamp = stamp;
+    }
 
-    // int order = currentIndex.row();
-    // get global index
-    int order = m_model->globalOrder(node, /*includeStart=*/false);
-    if (isStart) {
-      lblOrder->setText("0"); // start node order string
-    } else {
-      lblOrder->setText(QString::number(order+1));
+    // validation findings (see ProgramValidator)
+    const int severity = currentIndex.data(CommandModel::DiagnosticSeverityRole).toInt();
+    if (severity != CommandModel::NoIssue) {
+      const int px = lblTitle->fontMetrics().height();
+      lblDiag->setPixmap(style()->standardIcon(severityIcon(severity)).pixmap(px, px));
+      lblDiag->setToolTip(currentIndex.data(CommandModel::DiagnosticsRole).toStringList()
+                              .join(QLatin1Char('\n')));
     }
+    lblDiag->setVisible(severity != CommandModel::NoIssue);
+
+    const Actions a = actions(m_model, currentIndex);
+    btnUp->setEnabled(a.up);
+    btnDown->setEnabled(a.down);
+    btnDel->setEnabled(a.del);
+  }
 
-    rp::Command* c = m_model->commandFromIndex(currentIndex);
+  // Row content, shared with RowDelegate which paints the same row without
+  // any widget.
+  struct Actions { bool up; bool down; bool del; };
+
+  static int orderNumber(CommandModel* model, const QModelIndex& idx) {
+    auto* node = static_cast<rp::CommandNode*>(idx.internalPointer());
+    if (model->isStartNode(node)) {
+      return 0; // start node order
+    }
+    // get global index
+    return model->globalOrder(node, /*includeStart=*/false) + 1;
+  }
+
+  // Formats; callers cache the result under CommandNode::textStamp().
+  static QString titleText(CommandModel* model, const QModelIndex& idx) {
+    rp::Command* c = model->commandFromIndex(idx);
     // [Type name] [Name] [Information]
     QString title = c ? ( c->typeName() + QString(" [%1]: %2")
                                              .arg(c->commandName())
                                              .arg(c->info()) )
                       : QString("Command error");
 
-    // lblOrder->setText(QString::number(order));
-    lblTitle->setText(title);
+    // block totals (cached in the model)
+    if (c && c->isAllowChild()) {
+      const int moves = idx.data(CommandModel::MoveCountRole).toInt();
+      if (moves > 0) {
+        title += QString("  (%1 moves, %2 mm, %3 s)")
+                     .arg(moves)
+                     .arg(idx.data(CommandModel::PathLengthRole).toDouble(), 0, 'f', 1)
+                     .arg(idx.data(CommandModel::EstimatedTimeRole).toDouble(), 0, 'f', 2);
+      }
+    }
+    return title;
+  }
 
+  static Actions actions(CommandModel* model, const QModelIndex& idx) {
+    auto* node = static_cast<rp::CommandNode*>(idx.internalPointer());
+    const bool isStart = model->isStartNode(node);
     rp::CommandNode* parent = node->parent();
     const int r = node->row();
     const int last = parent ? (parent->childCount() - 1) : 0;
     const bool parentIsRoot = (parent && parent->parent() == nullptr);
 
-    bool canDelete = !isStart;
-    bool canDown   = !isStart && (r < last);
-    bool canUp     = !isStart && (parentIsRoot ? (r > 1) : (r > 0));
+    Actions a;
+    a.del  = !isStart;
+    a.down = !isStart && (r < last);
+    a.up   = !isStart && (parentIsRoot ? (r > 1) : (r > 0));
+    return a;
+  }
+
+  static QStyle::StandardPixmap severityIcon(int severity) {
+    return severity == CommandModel::Error ? QStyle::SP_MessageBoxCritical
+                                           : QStyle::SP_MessageBoxWarning;
+  }
 
-    btnUp->setEnabled(canUp);
-    btnDown->setEnabled(canDown);
-    btnDel->setEnabled(canDelete);
+  // highlight for the command being executed
+  void setActive(bool active) {
+    if (active) {
+      QPalette pal = palette();
+      pal.setColor(QPalette::Window, pal.color(QPalette::Highlight).lighter(170));
+      setPalette(pal);
+    } else {
+      setPalette(QPalette());
+    }
+    setAutoFillBackground(active);
   }
 
   // // fix row height 36px
@@ -131,16 +202,13 @@ public:
   // }
 
 signals:
-  void requestUp(const QModelIndex& idx);
-  void requestDown(const QModelIndex& idx);
-  void requestDelete(const QModelIndex& idx);
-  void rowClicked(Command* cmd);
+  void rowAction(const QModelIndex& idx, rp::RowAction action);
 
 protected:
   bool eventFilter(QObject* obj, QEvent* ev) override {
     if (obj == lblTitle && ev->type() == QEvent::MouseButtonRelease) {
       if (!m_model) return false;
-      if (Command* c = m_model->commandFromIndex(currentIndex)) emit rowClicked(c);
+      emit rowAction(currentIndex, RowAction::Click);
     }
     return QWidget::eventFilter(obj, ev);
   }
@@ -150,12 +218,15 @@ private:
   QLabel* lblTypeName {nullptr};
   QLabel* lblOrder {nullptr};
   QLabel* lblTitle {nullptr};
+  QLabel* lblDiag {nullptr};
   QPushButton* btnUp {nullptr};
   QPushButton* btnDown {nullptr};
   QPushButton* btnDel {nullptr};
 
   QModelIndex currentIndex;
   CommandModel* m_model {nullptr};
+  int m_shownOrder {-1};
+  quint64 m_shownStamp {0};
 };
 
 }
@@ -0,0 +1,329 @@
+#include "commandsearchindex.h"
+#include "commandmodel.h"
+#include <QStringList>
+#include <algorithm>
+
+namespace rp {
+
+CommandSearchIndex::CommandSearchIndex(CommandModel* model, QObject* parent)
+    : QObject(parent), m_model(model) {
+  connect(model, &QAbstractItemModel::dataChanged, this,
+          [this](const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                 const QList<int>& roles) {
+            if (m_stale || CommandModel::isDiagnosticsOnly(roles)) return;
+            for (int r = topLeft.row(); r <= bottomRight.row(); ++r) {
+              CommandNode* n = m_model->nodeFromIndex(m_model->index(r, 0, topLeft.parent()));
+              remove(n);
+              add(n);
+            }
+            maybeCompact();
+          });
+  connect(model, &QAbstractItemModel::rowsInserted, this,
+          [this](const QModelIndex& parent, int first, int last) {
+            if (m_stale) return;
+            // fetched rows were indexed as pending rows of the parent
+            fetched(parent.isValid() ? m_model->nodeFromIndex(parent) : m_model->rootNode());
+            for (int r = first; r <= last; ++r) {
+              addSubtree(m_model->nodeFromIndex(m_model->index(r, 0, parent)));
+            }
+            maybeCompact();
+          });
+  connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+          [this](const QModelIndex& parent, int first, int last) {
+            if (m_stale) return;
+            for (int r = first; r <= last; ++r) {
+              removeSubtree(m_model->nodeFromIndex(m_model->index(r, 0, parent)));
+            }
+            maybeCompact();
+          });
+  connect(model, &QAbstractItemModel::modelReset, this, [this]{ m_stale = true; });
+}
+
+QString CommandSearchIndex::textOf(const Command* c) {
+  if (!c) return {};
+  return (c->typeName() + QLatin1Char('\n') + c->commandName() + QLatin1Char('\n')
+          + c->info()).toCaseFolded();
+}
+
+// Sorted, unique. Three UTF-16 units packed into one key.
+void CommandSearchIndex::trigramsOf(QStringView text, std::vector<quint64>& out) {
+  out.clear();
+  const QChar* s = text.constData();
+  for (qsizetype i = 0; i + 2 < text.size(); ++i) {
+    out.push_back((quint64(s[i].unicode()) << 32) | (quint64(s[i + 1].unicode()) << 16)
+                  | quint64(s[i + 2].unicode()));
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+int CommandSearchIndex::addDoc(CommandNode* node, int ordinal, const QString& text) const {
+  const int id = int(m_node.size());
+  m_node.push_back(node);
+  m_ordinal.push_back(ordinal);
+  if (m_start.empty()) m_start.push_back(0);
+  m_chars.append(text);
+  m_start.push_back(m_chars.size());
+  ++m_size;
+
+  std::vector<quint64> grams;
+  trigramsOf(text, grams);
+  for (quint64 g : grams) m_postings[g].push_back(id);
+  m_postingCount += grams.size();
+  return id;
+}
+
+// The id's postings stay behind as dead entries until compact().
+void CommandSearchIndex::dropDoc(int id) const {
+  const qsizetype len = m_start[id + 1] - m_start[id];
+  m_deadCount += len > 2 ? std::size_t(len - 2) : 0; // upper bound, repeats counted
+  m_node[id] = nullptr; // its text stays in m_chars until compact()
+  --m_size;
+}
+
+void CommandSearchIndex::add(CommandNode* node) const {
+  if (!node || !node->command() || m_idOf.contains(node)) return;
+  m_idOf.insert(node, addDoc(node, -1, textOf(node->command().get())));
+}
+
+void CommandSearchIndex::addSubtree(CommandNode* node) const {
+  std::vector<CommandNode*> stack;
+  if (node) stack.push_back(node);
+  while (!stack.empty()) {
+    CommandNode* n = stack.back();
+    stack.pop_back();
+    add(n);
+    track(n);
+    for (int i = 0; i < n->childCount(); ++i) stack.push_back(n->child(i));
+  }
+}
+
+void CommandSearchIndex::remove(const CommandNode* node) const {
+  auto it = m_idOf.find(node);
+  if (it == m_idOf.end()) return;
+  dropDoc(it.value());
+  m_idOf.erase(it);
+}
+
+void CommandSearchIndex::removeSubtree(CommandNode* node) const {
+  std::vector<CommandNode*> stack;
+  if (node) stack.push_back(node);
+  while (!stack.empty()) {
+    CommandNode* n = stack.back();
+    stack.pop_back();
+    remove(n);
+    forget(n);
+    for (int i = 0; i < n->childCount(); ++i) stack.push_back(n->child(i));
+  }
+}
+
+// Indexes the pending rows of `owner` straight from its source.
+void CommandSearchIndex::track(CommandNode* owner) const {
+  if (!owner->hasPendingChildren() || m_owners.contains(owner)) return;
+  Owner o {owner->pendingNodeCount(), 0, int(m_node.size()), 0};
+  owner->childSource()->visit(0, [&](const ChildSource::PendingRow& row) {
+    addDoc(owner, o.count++, textOf(row.command));
+    return true;
+  });
+  m_owners.insert(owner, o);
+}
+
+// Pending rows of `owner` that became nodes are indexed as rows from now on.
+void CommandSearchIndex::fetched(CommandNode* owner) const {
+  auto it = m_owners.find(owner);
+  if (it == m_owners.end()) return;
+  Owner& o = it.value();
+  const int consumed = o.base - owner->pendingNodeCount();
+  const int k = std::min(consumed - o.firstOrdinal, o.count);
+  for (int i = 0; i < k; ++i) dropDoc(o.firstId + i);
+  o.firstOrdinal += k;
+  o.firstId += k;
+  o.count -= k;
+  if (!owner->hasPendingChildren()) m_owners.erase(it);
+}
+
+void CommandSearchIndex::forget(const CommandNode* owner) const {
+  auto it = m_owners.find(owner);
+  if (it == m_owners.end()) return;
+  for (int i = 0; i < it->count; ++i) dropDoc(it->firstId + i);
+  m_owners.erase(it);
+}
+
+void CommandSearchIndex::maybeCompact() const {
+  if (m_deadCount > m_postingCount / 2 + 1024) compact();
+}
+
+// Renumbers the live documents in order and re-derives every posting list.
+void CommandSearchIndex::compact() const {
+  std::vector<int> newId(m_node.size(), -1);
+  QString chars;
+  chars.reserve(m_chars.size());
+  int live = 0;
+  for (int id = 0; id < int(m_node.size()); ++id) {
+    if (!m_node[id]) continue;
+    newId[id] = live;
+    m_node[live] = m_node[id];
+    m_ordinal[live] = m_ordinal[id];
+    const QStringView t = text(id);
+    m_start[live] = chars.size();
+    chars.append(t);
+    ++live;
+  }
+  m_node.resize(live);
+  m_ordinal.resize(live);
+  m_start.resize(live + 1);
+  m_start[live] = chars.size();
+  m_chars = std::move(chars);
+  for (auto it = m_idOf.begin(); it != m_idOf.end(); ++it) it.value() = newId[it.value()];
+  for (auto it = m_owners.begin(); it != m_owners.end(); ++it) {
+    if (it->count > 0) it->firstId = newId[it->firstId]; // still contiguous
+  }
+
+  m_postings.clear();
+  m_postingCount = 0;
+  m_deadCount = 0;
+  std::vector<quint64> grams;
+  for (int id = 0; id < live; ++id) {
+    trigramsOf(text(id), grams);
+    for (quint64 g : grams) m_postings[g].push_back(id);
+    m_postingCount += grams.size();
+  }
+}
+
+void CommandSearchIndex::rebuild() const {
+  m_node.clear();
+  m_ordinal.clear();
+  m_chars.clear();
+  m_start.clear();
+  m_idOf.clear();
+  m_owners.clear();
+  m_postings.clear();
+  m_postingCount = 0;
+  m_deadCount = 0;
+  m_size = 0;
+  addSubtree(m_model->rootNode());
+  m_stale = false;
+}
+
+std::vector<CommandNode*> CommandSearchIndex::find(const QString& query,
+                                                   std::vector<PendingMatch>* pending) const {
+  if (m_stale) rebuild();
+  if (pending) pending->clear();
+
+  std::vector<CommandNode*> result;
+  const QStringList terms = query.toCaseFolded().split(QLatin1Char(' '), Qt::SkipEmptyParts);
+  if (terms.isEmpty()) return result;
+
+  // A three-character term is its own trigram, so being listed under it is
+  // the match; every other term still needs the substring test.
+  std::vector<const std::vector<int>*> lists;
+  QStringList verify;
+  std::vector<quint64> grams;
+  for (const QString& t : terms) {
+    if (t.size() != 3) verify.append(t);
+    trigramsOf(t, grams);
+    for (quint64 g : grams) {
+      auto it = m_postings.constFind(g);
+      if (it == m_postings.constEnd()) return result; // no row has it
+      lists.push_back(&it.value());
+    }
+  }
+
+  // Every term shorter than three characters: the longest one is found
+  // through the trigrams containing it (any text with more than the two
+  // separators has three characters or more).
+  std::vector<int> shortList;
+  if (lists.empty()) {
+    auto longest = std::max_element(verify.begin(), verify.end(),
+        [](const QString& a, const QString& b) { return a.size() < b.size(); });
+    const QString t = *longest;
+    verify.erase(longest);
+    std::vector<char> hit(m_node.size(), 0);
+    for (auto it = m_postings.cbegin(); it != m_postings.cend(); ++it) {
+      const quint64 g = it.key();
+      const QChar c[3] = {QChar(ushort(g >> 32)), QChar(ushort(g >> 16)), QChar(ushort(g))};
+      if (!QStringView(c, 3).contains(t)) continue;
+      for (int id : it.value()) hit[id] = 1;
+    }
+    for (int id = 0; id < int(hit.size()); ++id) {
+      if (hit[id]) shortList.push_back(id);
+    }
+    lists.push_back(&shortList);
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<int>* a, const std::vector<int>* b) { return a->size() < b->size(); });
+  lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+  // Candidates: the intersection of all lists, rarest first. A list much
+  // longer than the candidates is searched from the last hit with doubling
+  // steps, O(candidates * log(list)); otherwise both are merged linearly.
+  std::vector<int> candidates = *lists.front();
+  for (std::size_t l = 1; l < lists.size() && !candidates.empty(); ++l) {
+    const std::vector<int>& list = *lists[l];
+    auto from = list.begin();
+    std::size_t kept = 0;
+    if (list.size() / candidates.size() < 16) {
+      for (int id : candidates) {
+        while (from != list.end() && *from < id) ++from;
+        if (from == list.end()) break;
+        if (*from == id) candidates[kept++] = id;
+      }
+    } else {
+      for (int id : candidates) {
+        std::ptrdiff_t step = 1;
+        auto to = from;
+        while (to != list.end() && *to < id) {
+          from = to;
+          to = (list.end() - to > step) ? to + step : list.end();
+          step *= 2;
+        }
+        from = std::lower_bound(from, to, id);
+        if (from == list.end()) break;
+        if (*from == id) candidates[kept++] = id;
+      }
+    }
+    candidates.resize(kept);
+  }
+  result.reserve(candidates.size());
+
+  CommandNode* owner = nullptr; // pending matches come in runs per owner
+  int last = -1;
+  QHash<CommandNode*, std::size_t> slotOf;
+  auto flushOwner = [&] {
+    if (!owner) return;
+    const int consumed = m_owners.value(owner).base - owner->pendingNodeCount();
+    const int nodes = last - consumed + 1;
+    auto it = slotOf.constFind(owner);
+    if (it == slotOf.constEnd()) {
+      slotOf.insert(owner, pending->size());
+      pending->emplace_back(owner, nodes);
+    } else {
+      PendingMatch& m = (*pending)[it.value()];
+      m.second = std::max(m.second, nodes);
+    }
+  };
+  for (int id : candidates) {
+    CommandNode* n = m_node[id];
+    if (!n) continue; // dead
+    const QStringView doc = text(id);
+    bool ok = true;
+    for (const QString& t : verify) {
+      if (!doc.contains(t)) { ok = false; break; }
+    }
+    if (!ok) continue;
+    if (m_ordinal[id] < 0) {
+      result.push_back(n);
+    } else if (pending) {
+      if (n != owner) {
+        flushOwner();
+        owner = n;
+        last = -1;
+      }
+      last = std::max(last, m_ordinal[id]);
+    }
+  }
+  if (pending) flushOwner();
+  return result;
+}
+
+}
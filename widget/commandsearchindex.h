@@ -0,0 +1,96 @@
+#ifndef COMMANDSEARCHINDEX_H
+#define COMMANDSEARCHINDEX_H
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <utility>
+#include <vector>
+
+namespace rp {
+
+class CommandModel;
+class CommandNode;
+class Command;
+
+/**
+ * Command search index
+ * Case-insensitive substring search over typeName(), commandName() and
+ * info() of every row, pending ones included: rows still in a ChildSource
+ * are read through ChildSource::visit() and indexed under the node that owns
+ * them, without fetching anything. Each row's text is split into trigrams
+ * and the index maps a trigram to the sorted ids of the rows containing it;
+ * a query intersects the lists of all its trigrams, rarest first, and only
+ * confirms the survivors with a substring test for terms other than three
+ * characters long. The index follows model signals row by row and is
+ * rebuilt lazily after a reset.
+*/
+class CommandSearchIndex : public QObject {
+  Q_OBJECT
+public:
+  explicit CommandSearchIndex(CommandModel* model, QObject* parent = nullptr);
+
+  // A block (the invisible root for top-level rows) with matches among its
+  // pending rows: fetching `nodes` more of its pending nodes, counted in
+  // pre-order, materializes the last of them (or the pending row holding it).
+  using PendingMatch = std::pair<CommandNode*, int>;
+
+  // Rows whose text contains every whitespace-separated term of `query`,
+  // in no particular order. Matches that are still pending are not rows
+  // yet: they go to `pending`, one entry per block, or are left out.
+  std::vector<CommandNode*> find(const QString& query,
+                                 std::vector<PendingMatch>* pending = nullptr) const;
+
+  // Indexed rows, pending ones included.
+  int size() const { return m_size; }
+
+private:
+  // Pending rows of one block. They were read in one pass, so the ids of
+  // the ones not fetched yet are contiguous.
+  struct Owner {
+    int base;         // pendingNodeCount() when read
+    int firstOrdinal; // first pending row still indexed
+    int firstId;
+    int count;
+  };
+
+  int addDoc(CommandNode* node, int ordinal, const QString& text) const;
+  void dropDoc(int id) const;
+  void add(CommandNode* node) const;
+  void addSubtree(CommandNode* node) const;
+  void remove(const CommandNode* node) const;
+  void removeSubtree(CommandNode* node) const;
+  void track(CommandNode* owner) const;
+  void fetched(CommandNode* owner) const;
+  void forget(const CommandNode* owner) const;
+  void maybeCompact() const;
+  void rebuild() const;
+  void compact() const;
+  QStringView text(int id) const {
+    return QStringView(m_chars).mid(m_start[id], m_start[id + 1] - m_start[id]);
+  }
+  static QString textOf(const Command* c);
+  static void trigramsOf(QStringView text, std::vector<quint64>& out);
+
+  CommandModel* m_model;
+
+  // Documents are dense ids, never reused until compact() renumbers them,
+  // so every posting list is ascending. Lists may hold ids whose row
+  // changed or went away since; those are dead (m_node is nullptr) and
+  // compact() drops them once they pile up.
+  mutable std::vector<CommandNode*> m_node; // the row, or the owner of a pending row
+  mutable std::vector<int> m_ordinal;       // pending rows: position in the owner's source; -1 for rows
+  mutable QString m_chars;                  // case-folded texts back to back, in id order
+  mutable std::vector<qsizetype> m_start;   // text of id i is [m_start[i], m_start[i + 1])
+  mutable QHash<const CommandNode*, int> m_idOf; // rows only
+  mutable QHash<const CommandNode*, Owner> m_owners;
+  mutable QHash<quint64, std::vector<int>> m_postings;
+  mutable std::size_t m_postingCount {0};
+  mutable std::size_t m_deadCount {0};
+  mutable int m_size {0};
+  mutable bool m_stale {true};
+};
+
+}
+
+#endif // COMMANDSEARCHINDEX_H
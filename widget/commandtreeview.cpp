@@ -1,5 +1,6 @@
 #include "commandtreeview.h"
 #include "commandrowwidget.h"
+#include "commandsearchindex.h"
 #include "hyprgcommand.h"
 #include <QHeaderView>
 #include <QMouseEvent>
@@ -13,30 +14,29 @@ struct NodeEntry {
   QString label;
 };
 
-void enumerateDfs(rp::CommandModel* m, const QModelIndex& parent,
-                  QVector<NodeEntry>& out, int depth, bool includeStart) {
-  int rows = m->rowCount(parent);
-  for (int r = 0; r < rows; ++r) {
-    QModelIndex idx = m->index(r, 0, parent);
-    auto* node = m->nodeFromIndex(idx);
-    bool isStart = m->isStartNode(node);
-
-    bool countThis = includeStart || !isStart;
-    if (countThis) {
-      rp::Command* c = m->commandFromIndex(idx);
-      if (!c->isAllowChild()) {
-        continue;
-      }
-
-      int cmdGlobalIndex = m->globalOrder(node, includeStart) + 1;
-      QString indent(depth*2, QLatin1Char(' '));
-      out.push_back(NodeEntry{ cmdGlobalIndex, idx, QStringLiteral("%1%2: %3 [%4]")
-                                                .arg(indent)
-                                                .arg(cmdGlobalIndex)
-                                                .arg(c->typeName())
-                                                .arg(c->commandName()) });
+// Linear scan over the flat mirror: slot == pre-order position, so the
+// global index and indentation come straight from the arrays.
+void enumerateDfs(rp::CommandModel* m, QVector<NodeEntry>& out, bool includeStart) {
+  const FlatCommandTree& flat = m->flatTree();
+  int startOffset = 0;
+  for (int slot = 0; slot < flat.size(); ++slot) {
+    rp::Command* c = flat.command(slot);
+    if (m->isStartNode(flat.node(slot))) {
+      if (!includeStart) startOffset = 1;
+      continue;
+    }
+    if (!c || !c->isAllowChild()) {
+      continue;
     }
-    enumerateDfs(m, idx, out, depth + 1, includeStart);
+
+    int cmdGlobalIndex = slot - startOffset + 1;
+    QString indent(flat.depth(slot)*2, QLatin1Char(' '));
+    out.push_back(NodeEntry{ cmdGlobalIndex, m->indexFromNode(flat.node(slot)),
+                             QStringLiteral("%1%2: %3 [%4]")
+                                 .arg(indent)
+                                 .arg(cmdGlobalIndex)
+                                 .arg(c->typeName())
+                                 .arg(c->commandName()) });
   }
 }
 
@@ -57,67 +57,66 @@ CommandTreeView::CommandTreeView(QWidget* parent)
     setHeaderHidden(true);            // no horizontal header
     setRootIsDecorated(true);         // show expanders for children
     setUniformRowHeights(true);
-
-    // Single column with persistent QWidget editor per row
-    auto* del = new RowDelegate(this);
-    setItemDelegate(del);
-
-    auto refreshAll = [this]{
-      // gọi sau một vòng event để Qt ổn định lại geometry
-      QMetaObject::invokeMethod(this, [this]{ refreshAllRows(); }, Qt::QueuedConnection);
-    };
-
+    setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    // Single column painted by the delegate; its buttons report here
+    m_delegate = new RowDelegate(this);
+    setItemDelegate(m_delegate);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    connect(m_delegate, &RowDelegate::rowAction, this, &CommandTreeView::dispatchRowAction);
+
+    // Each signal only records what it dirtied: rows at or after the first
+    // touched position change their number (plus the previous sibling, whose
+    // up/down state may flip), enclosing blocks change their totals, edited
+    // rows change their text. One refresh per event-loop turn then touches
+    // the visible rows among those.
     connect(m_model, &QAbstractItemModel::rowsInserted, this,
-            [=](auto,auto,auto){ refreshAll(); });
+            [this](const QModelIndex& parent, int first, int){
+              scheduleRefreshFrom(orderBefore(parent, first));
+              markAncestorsDirty(parent);
+            });
     connect(m_model, &QAbstractItemModel::rowsRemoved, this,
-            [=](auto,auto,auto){ refreshAll(); });
+            [this](const QModelIndex& parent, int first, int){
+              scheduleRefreshFrom(orderBefore(parent, first));
+              markAncestorsDirty(parent);
+            });
     connect(m_model, &QAbstractItemModel::rowsMoved, this,
-            [=](auto,auto,auto,auto,auto){ refreshAll(); });
+            [this](const QModelIndex& srcParent, int start, int,
+                   const QModelIndex& dstParent, int row){
+              scheduleRefreshFrom(std::min(orderBefore(srcParent, start),
+                                           orderBefore(dstParent, row)));
+              markAncestorsDirty(srcParent);
+              markAncestorsDirty(dstParent);
+            });
     connect(m_model, &QAbstractItemModel::modelReset, this,
-            [=]{ refreshAll(); });
+            [this]{ scheduleRefreshFrom(0); });
     connect(m_model, &QAbstractItemModel::dataChanged, this,
-            [=](auto,auto,auto){ refreshAll(); });
-
-    // Open persistent editors for all existing and future rows
-    openEditorsRecursively(QModelIndex());
-    connect(m_model, &QAbstractItemModel::rowsInserted, this,
-            [this](const QModelIndex& parent, int first, int last){
-        for (int r = first; r <= last; ++r) {
-            QModelIndex idx = m_model->index(r, 0, parent);
-            openPersistentEditor(idx);
-            if (auto* w = qobject_cast<CommandRowWidget*>(indexWidget(idx))) {
-                connect(w, &CommandRowWidget::requestUp, this,
-                      [this](const QModelIndex& i) {
-                        if (m_model->moveUp(i)) {
-                          if (Command* c = m_model->commandFromIndex(i)) {
-                            emit commandMoved(c);
-                          }
-                        }
-                });
-
-                connect(w, &CommandRowWidget::requestDown, this,
-                        [this](const QModelIndex& i) {
-                          if (m_model->moveDown(i)) {
-                            if (Command* c = m_model->commandFromIndex(i)) {
-                              emit commandMoved(c);
-                            }
-                          }
-                });
-
-                connect(w, &CommandRowWidget::requestDelete, this,
-                        [this](const QModelIndex& i) {
-                          if (Command* c = m_model->commandFromIndex(i)) {
-                            emit commandWillBeDeleted(c); m_model->removeCommand(i);
-                          }
-                });
-
-                connect(w, &CommandRowWidget::rowClicked, this,
-                        [this](Command* c) {
-                          emit commandClicked(c);
-                });
-            }
-        }
-    });
+            [this](const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                   const QList<int>& roles){
+              // parameters changed, numbering did not: just these rows
+              for (int r = topLeft.row(); r <= bottomRight.row(); ++r) {
+                markRowDirty(m_model->index(r, 0, topLeft.parent()));
+              }
+              if (!CommandModel::isDiagnosticsOnly(roles)) {
+                markAncestorsDirty(topLeft.parent());
+              }
+            });
+
+    // Row widgets (if enabled) follow whatever changes the visible rows
+    auto relayout = [this]{ scheduleRowLayout(); };
+    connect(m_model, &QAbstractItemModel::rowsInserted, this, relayout);
+    connect(m_model, &QAbstractItemModel::rowsRemoved, this, relayout);
+    connect(m_model, &QAbstractItemModel::rowsMoved, this, relayout);
+    connect(m_model, &QAbstractItemModel::modelReset, this, relayout);
+    connect(m_model, &QAbstractItemModel::layoutChanged, this, relayout);
+    connect(this, &QTreeView::expanded, this, relayout);
+    connect(this, &QTreeView::collapsed, this, relayout);
+
+    // a structural change while filtering re-runs the filter from scratch
+    connect(m_model, &QAbstractItemModel::rowsInserted, this, &CommandTreeView::scheduleFilterReset);
+    connect(m_model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &CommandTreeView::scheduleFilterReset);
+    connect(m_model, &QAbstractItemModel::rowsMoved, this, &CommandTreeView::scheduleFilterReset);
+    connect(m_model, &QAbstractItemModel::modelReset, this, &CommandTreeView::scheduleFilterReset);
 
     // Context menu
     setContextMenuPolicy(Qt::CustomContextMenu);
@@ -133,6 +132,7 @@ CommandTreeView::CommandTreeView(QWidget* parent)
 }
 
 void CommandTreeView::registerCommandType(const QString& typeName, CommandFactory factory) {
+    CommandRegistry::registerCommand(typeName, factory); // for loading programs
     m_registry[typeName] = std::move(factory);
 }
 
@@ -142,6 +142,156 @@ void CommandTreeView::addAtRoot(rp::CommandPtr cmd) {
   }
 }
 
+// select and scroll to the row labelled `number` (1-based, Start excluded)
+void CommandTreeView::jumpToCommand(int number) {
+  QModelIndex idx = m_model->indexAtGlobalOrder(number - 1);
+  if (!idx.isValid()) {
+    return;
+  }
+  setCurrentIndex(idx);
+  scrollTo(idx);
+}
+
+void CommandTreeView::setActiveCommand(quint64 commandId) {
+  if (CommandRowWidget* w = rowWidget(m_activeRow)) {
+    w->setActive(false);
+  }
+  if (m_activeRow.isValid()) update(m_activeRow);
+  m_activeRow = m_model->findIndexById(commandId);
+  m_delegate->setActiveIndex(m_activeRow);
+  if (!m_activeRow.isValid()) {
+    return;
+  }
+  scrollTo(m_activeRow);
+  update(m_activeRow);
+  if (CommandRowWidget* w = rowWidget(m_activeRow)) {
+    w->setActive(true);
+  }
+}
+
+void CommandTreeView::setRowWidgets(bool enabled) {
+  if (enabled == m_rowWidgets) return;
+  m_rowWidgets = enabled;
+  m_delegate->setPaintContent(!enabled); // widgets draw the row themselves
+  if (enabled) {
+    layoutRowWidgets();
+  } else {
+    for (CommandRowWidget* w : std::as_const(m_boundRows)) {
+      w->hide();
+      m_spareRows.push_back(w);
+    }
+    m_boundRows.clear();
+  }
+  viewport()->update();
+}
+
+void CommandTreeView::setFilterText(const QString& text) {
+  const QString filter = text.simplified();
+  if (filter == m_filter) return;
+  m_filter = filter;
+  applyFilter();
+}
+
+void CommandTreeView::scheduleFilterReset() {
+  if (!m_filtering || m_filterReset) return;
+  m_filterReset = true; // m_filterVisible may hold rows about to be freed
+  QMetaObject::invokeMethod(this, [this]{ applyFilter(); }, Qt::QueuedConnection);
+}
+
+void CommandTreeView::hideRow(const QModelIndex& idx, bool hide) {
+  if (!idx.isValid()) return;
+  setRowHidden(idx.row(), idx.parent(), hide);
+  if (hide) m_filterHidden.append(QPersistentModelIndex(idx));
+}
+
+// Diff against the previous result: rows that dropped out are hidden, rows
+// that came in are shown, and only blocks that just became visible get
+// their other children hidden.
+void CommandTreeView::applyFilter() {
+  // Matches among pending rows are fetched, each block only as far as its
+  // last match; blocks that brings in are searched on the next round.
+  // Fetching may flag a reset, which is handled right below.
+  std::vector<CommandNode*> matches;
+  if (!m_filter.isEmpty()) {
+    if (!m_search) m_search = new CommandSearchIndex(m_model, this);
+    std::vector<CommandSearchIndex::PendingMatch> pending;
+    matches = m_search->find(m_filter, &pending);
+    while (!pending.empty()) {
+      for (const auto& [owner, nodes] : pending) {
+        const QModelIndex idx = m_model->indexFromNode(owner);
+        const int target = owner->pendingNodeCount() - nodes;
+        while (owner->pendingNodeCount() > target && m_model->canFetchMore(idx)) {
+          m_model->fetchMore(idx);
+        }
+      }
+      matches = m_search->find(m_filter, &pending);
+    }
+  }
+
+  if (m_filterReset || m_filter.isEmpty()) {
+    for (const QPersistentModelIndex& idx : std::as_const(m_filterHidden)) {
+      if (idx.isValid()) setRowHidden(idx.row(), idx.parent(), false);
+    }
+    m_filterHidden.clear();
+    m_filterVisible.clear();
+    m_filtering = false;
+    m_filterReset = false;
+    if (m_filter.isEmpty()) return;
+  }
+
+  QSet<CommandNode*> visible; // matches and their ancestors
+  for (CommandNode* n : matches) {
+    for (; n && n->parent() && !visible.contains(n); n = n->parent()) {
+      visible.insert(n);
+    }
+  }
+
+  for (CommandNode* n : std::as_const(m_filterVisible)) {
+    if (!visible.contains(n)) hideRow(m_model->indexFromNode(n), true);
+  }
+
+  // returns whether any child stays visible
+  auto hideOthers = [&](const QModelIndex& parent) {
+    bool any = false;
+    const int rows = m_model->rowCount(parent);
+    for (int r = 0; r < rows; ++r) {
+      const QModelIndex idx = m_model->index(r, 0, parent);
+      if (visible.contains(m_model->nodeFromIndex(idx))) any = true;
+      else hideRow(idx, true);
+    }
+    return any;
+  };
+  if (!m_filtering) {
+    hideOthers(QModelIndex());
+    m_filtering = true;
+  }
+  for (CommandNode* n : std::as_const(visible)) {
+    if (m_filterVisible.contains(n)) continue;
+    const QModelIndex idx = m_model->indexFromNode(n);
+    setRowHidden(idx.row(), idx.parent(), false);
+    if (n->childCount() > 0 && hideOthers(idx)) {
+      expand(idx); // enclosing block of a match
+    }
+  }
+  m_filterVisible = std::move(visible);
+}
+
+void CommandTreeView::addAtRoot(const std::vector<CommandPtr>& cmds) {
+  m_model->insertCommands(QModelIndex(), -1, cmds);
+}
+
+// bulk version of addChildAtSelection: one model insert, one refresh
+void CommandTreeView::addChildrenAtSelection(const std::vector<CommandPtr>& cmds) {
+  QModelIndex sel = currentIndex();
+  if (sel.isValid()) {
+    if (m_model->insertCommands(sel, -1, cmds)) {
+      expand(sel);
+    }
+  } else {
+    m_model->insertCommands(QModelIndex(), -1, cmds);
+  }
+}
+
 // add child at selecting node, if not select any node, command will add at root
 void CommandTreeView::addChildAtSelection(rp::CommandPtr cmd) {
   if (!cmd) {
@@ -249,7 +399,6 @@ void CommandTreeView::onCustomContextMenuRequested(const QPoint& pos) {
       //   // move into selected node
       //   if (m_model->moveInto(idx, dstParentIdx)) {
       //     expand(dstParentIdx);
-      //     refreshAllRows();
       //     if (rp::Command* c = m_model->commandFromIndex(idx)) {
       //       emit commandMoved(c);
       //     }
@@ -258,16 +407,29 @@ void CommandTreeView::onCustomContextMenuRequested(const QPoint& pos) {
       // Q_UNUSED(moveInsideAct);
     // }
 
+    // Clicked row inside a multi-selection: the actions below apply to all
+    // selected rows through the batch model API.
+    const QList<QPersistentModelIndex> targets = actionTargets(idx);
+
+    if (targets.size() > 1) {
+      m_ctxMenu->addAction(tr("Move selection up"), [this, targets]{
+        std::vector<Command*> moved;
+        if (m_model->moveUp(toIndexList(targets), &moved)) emitMoved(moved);
+      });
+      m_ctxMenu->addAction(tr("Move selection down"), [this, targets]{
+        std::vector<Command*> moved;
+        if (m_model->moveDown(toIndexList(targets), &moved)) emitMoved(moved);
+      });
+    }
+
     QMenu* moveInsideMenu = m_ctxMenu->addMenu("Move inside…");
 
     // 2.1) Thêm lựa chọn Move out (to root)
-    QAction* moveOutAct = moveInsideMenu->addAction("Move out (to root)", [this, idx]{
+    QAction* moveOutAct = moveInsideMenu->addAction("Move out (to root)", [this, targets]{
       // chèn về cuối root (sau Start)
-      if (m_model->moveToRoot(idx, /*atRow=*/-1)) {
-        // mở lại view nếu cần và refresh thứ tự
-        // (nếu bạn có hàm refreshAllRows như đã đề cập)
-        // refreshAllRows();
-        if (rp::Command* c = m_model->commandFromIndex(idx)) emit commandMoved(c);
+      std::vector<Command*> moved;
+      if (m_model->moveToRoot(toIndexList(targets), /*atRow=*/-1, &moved)) {
+        emitMoved(moved);
       }
     });
     Q_UNUSED(moveOutAct);
@@ -276,36 +438,40 @@ void CommandTreeView::onCustomContextMenuRequested(const QPoint& pos) {
 
     QVector<NodeEntry> entries;
     bool includeStart = false;
-    enumerateDfs(m_model, QModelIndex(), entries, /*depth*/0, includeStart);
-
-    auto* srcNode = m_model->nodeFromIndex(idx);
+    enumerateDfs(m_model, entries, includeStart);
 
     // Dựng menu lựa chọn
     for (const auto& e : entries) {
       auto* dstNode = m_model->nodeFromIndex(e.idx);
-      // Ẩn chính nó
-      if (dstNode == srcNode) continue;
-      // Ẩn hậu duệ của nó
-      if (isDescendant(dstNode, srcNode)) continue;
-
-      QAction* a = moveInsideMenu->addAction(e.label, [this, idx, e]{
-        if (m_model->moveInto(idx, e.idx)) {
-          expand(e.idx);
-          // refreshAllRows();
-          if (rp::Command* c = m_model->commandFromIndex(idx)) emit commandMoved(c);
+      bool hidden = false;
+      for (const QPersistentModelIndex& t : targets) {
+        auto* srcNode = m_model->nodeFromIndex(t);
+        // Ẩn chính nó và hậu duệ của nó
+        if (dstNode == srcNode || isDescendant(dstNode, srcNode)) { hidden = true; break; }
+      }
+      if (hidden) continue;
+
+      QPersistentModelIndex dst = e.idx;
+      QAction* a = moveInsideMenu->addAction(e.label, [this, targets, dst]{
+        std::vector<Command*> moved;
+        if (m_model->moveInto(toIndexList(targets), dst, -1, &moved)) {
+          expand(dst);
+          emitMoved(moved);
         }
       });
 
       // (tùy chọn) có thể disable mục là parent hiện tại (no-op)
       auto* srcParent = m_model->nodeFromIndex(m_model->parent(idx));
-      if (dstNode == srcParent) a->setEnabled(false);
+      if (targets.size() == 1 && dstNode == srcParent) a->setEnabled(false);
     }
 
-    QAction* delAct = m_ctxMenu->addAction("Delete", [this, idx]{
-      if (Command* c = m_model->commandFromIndex(idx)) {
+    QAction* delAct = m_ctxMenu->addAction("Delete", [this, targets]{
+      // only what actually goes: never Start, nor rows inside a selected block
+      const QModelIndexList indexes = toIndexList(targets);
+      for (Command* c : m_model->removalTargets(indexes)) {
         emit commandWillBeDeleted(c);
       }
-      m_model->removeCommand(idx);
+      m_model->removeCommands(indexes);
     });
     Q_UNUSED(delAct);
 
@@ -330,45 +496,109 @@ void CommandTreeView::onCustomContextMenuRequested(const QPoint& pos) {
 //     expandAll();
 // }
 
-void CommandTreeView::openEditorsRecursively(const QModelIndex& parent) {
-    int rows = m_model->rowCount(parent);
-    for (int r = 0; r < rows; ++r) {
-        QModelIndex idx = m_model->index(r, 0, parent);
-        openPersistentEditor(idx);
-        if (auto* w = qobject_cast<CommandRowWidget*>(indexWidget(idx))) {
-          connect(w, &CommandRowWidget::requestUp, this,
-                  [this](const QModelIndex& i) {
-                    if (m_model->moveUp(i)) {
-                      if (Command* c = m_model->commandFromIndex(i)) {
-                        emit commandMoved(c);
-                      }
-                    }
-          });
+void CommandTreeView::scrollContentsBy(int dx, int dy) {
+  QTreeView::scrollContentsBy(dx, dy);
+  layoutRowWidgets(); // now, so rows scrolling in never show up empty
+}
 
-          connect(w, &CommandRowWidget::requestDown, this,
-                  [this](const QModelIndex& i) {
-                    if (m_model->moveDown(i)) {
-                      if (Command* c = m_model->commandFromIndex(i)) {
-                        emit commandMoved(c);
-                      }
-                    }
-          });
+void CommandTreeView::updateGeometries() {
+  QTreeView::updateGeometries();
+  scheduleRowLayout();
+}
 
-          connect(w, &CommandRowWidget::requestDelete, this,
-                  [this](const QModelIndex& i) {
-                    if (Command* c = m_model->commandFromIndex(i)) {
-                      emit commandWillBeDeleted(c);
-                    }
-                    m_model->removeCommand(i);
-          });
+void CommandTreeView::scheduleRowLayout() {
+  if (!m_rowWidgets || m_rowLayoutQueued) {
+    return;
+  }
+  m_rowLayoutQueued = true;
+  // after the view has laid out the changed rows
+  QMetaObject::invokeMethod(this, [this]{
+    m_rowLayoutQueued = false;
+    layoutRowWidgets();
+  }, Qt::QueuedConnection);
+}
 
-          connect(w, &CommandRowWidget::rowClicked, this,
-                  [this](Command* c) {
-                    emit commandClicked(c);
-          });
-        }
-        openEditorsRecursively(idx);
+// Virtualized row widgets: only rows intersecting the viewport have one.
+// A row keeps its widget while it stays visible, rows scrolling in take the
+// widgets of rows that scrolled out.
+void CommandTreeView::layoutRowWidgets() {
+  if (!m_rowWidgets) {
+    return;
+  }
+  QHash<const CommandNode*, CommandRowWidget*> previous;
+  previous.swap(m_boundRows);
+
+  const int bottom = viewport()->height();
+  for (QModelIndex idx = indexAt(QPoint(1, 1)); idx.isValid(); idx = indexBelow(idx)) {
+    const QRect r = visualRect(idx);
+    if (r.top() >= bottom) {
+      break;
+    }
+    const CommandNode* node = m_model->nodeFromIndex(idx);
+    CommandRowWidget* w = previous.take(node);
+    if (!w) {
+      w = takeRowWidget();
     }
+    if (w->index() != idx) {
+      w->setContext(idx, m_model); // rebinding refreshes the content
+    }
+    w->setActive(idx == m_activeRow);
+    w->setGeometry(r);
+    w->show();
+    m_boundRows.insert(node, w);
+  }
+
+  for (CommandRowWidget* w : std::as_const(previous)) {
+    w->hide();
+    m_spareRows.push_back(w);
+  }
+}
+
+// Widgets are created and connected once, then recycled; the pool never
+// outgrows the viewport.
+CommandRowWidget* CommandTreeView::takeRowWidget() {
+  if (!m_spareRows.empty()) {
+    CommandRowWidget* w = m_spareRows.back();
+    m_spareRows.pop_back();
+    return w;
+  }
+  auto* w = new CommandRowWidget(viewport());
+  connect(w, &CommandRowWidget::rowAction, this, &CommandTreeView::dispatchRowAction);
+  return w;
+}
+
+CommandRowWidget* CommandTreeView::rowWidget(const QModelIndex& idx) const {
+  if (!idx.isValid()) {
+    return nullptr;
+  }
+  CommandRowWidget* w = m_boundRows.value(m_model->nodeFromIndex(idx));
+  return w && w->index() == idx ? w : nullptr;
+}
+
+// Single entry point for row buttons and title clicks, whether painted by
+// the delegate or shown by a row widget. The command is resolved before the
+// model changes, so each action is announced exactly once and for the row
+// that was clicked.
+void CommandTreeView::dispatchRowAction(const QModelIndex& idx, RowAction action) {
+  Command* c = idx.model() == m_model ? m_model->commandFromIndex(idx) : nullptr;
+  if (!c) {
+    return;
+  }
+  switch (action) {
+  case RowAction::MoveUp:
+    if (m_model->moveUp(idx)) emit commandMoved(c);
+    break;
+  case RowAction::MoveDown:
+    if (m_model->moveDown(idx)) emit commandMoved(c);
+    break;
+  case RowAction::Delete:
+    emit commandWillBeDeleted(c);
+    m_model->removeCommand(idx);
+    break;
+  case RowAction::Click:
+    emit commandClicked(c);
+    break;
+  }
 }
 
 void CommandTreeView::userClickedOutsideRowItems() {
@@ -388,19 +618,101 @@ void CommandTreeView::userClickedOutsideRowItems() {
   m_ctxMenu->addMenu(sib_root);
 }
 
-void CommandTreeView::refreshAllRows()
-{
-  std::function<void(const QModelIndex&)> rec = [&](const QModelIndex& parent){
-    int rows = m_model->rowCount(parent);
-    for (int r = 0; r < rows; ++r) {
-      QModelIndex idx = m_model->index(r, 0, parent);
-      if (auto* w = qobject_cast<CommandRowWidget*>(indexWidget(idx))) {
-        w->refresh();
-      }
-      rec(idx);
-    }
+QList<QPersistentModelIndex> CommandTreeView::actionTargets(const QModelIndex& idx) const {
+  QList<QPersistentModelIndex> out;
+  if (selectionModel() && selectionModel()->isSelected(idx)) {
+    const QModelIndexList rows = selectionModel()->selectedRows();
+    for (const QModelIndex& r : rows) out.push_back(r);
+  }
+  if (out.isEmpty()) out.push_back(idx);
+  return out;
+}
+
+QModelIndexList CommandTreeView::toIndexList(const QList<QPersistentModelIndex>& indexes) {
+  QModelIndexList out;
+  out.reserve(indexes.size());
+  for (const QPersistentModelIndex& i : indexes) {
+    if (i.isValid()) out.push_back(i);
+  }
+  return out;
+}
+
+void CommandTreeView::emitMoved(const std::vector<Command*>& moved) {
+  for (Command* c : moved) emit commandMoved(c);
+}
+
+// Dirty state of one event-loop turn: every row from the smallest dirty
+// position on, plus individually dirtied rows.
+void CommandTreeView::scheduleRefreshFrom(int order) {
+  m_refreshFrom = std::min(m_refreshFrom, order);
+  scheduleRefresh();
+}
+
+void CommandTreeView::markRowDirty(const QModelIndex& idx) {
+  if (CommandNode* n = m_model->nodeFromIndex(idx)) {
+    m_dirtyRows.insert(n);
+    scheduleRefresh();
+  }
+}
+
+// enclosing blocks show totals of their rows
+void CommandTreeView::markAncestorsDirty(const QModelIndex& parent) {
+  for (QModelIndex p = parent; p.isValid(); p = p.parent()) {
+    markRowDirty(p);
+  }
+}
+
+void CommandTreeView::scheduleRefresh() {
+  if (m_refreshQueued) {
+    return;
+  }
+  m_refreshQueued = true;
+  // gọi sau một vòng event để Qt ổn định lại geometry
+  QMetaObject::invokeMethod(this, [this]{ flushRefresh(); }, Qt::QueuedConnection);
+}
+
+// Visits the visible rows only and refreshes those the pending signals
+// dirtied. Dirty nodes are only compared, never dereferenced: some may have
+// been deleted since they were recorded.
+void CommandTreeView::flushRefresh() {
+  const int from = m_refreshFrom;
+  QSet<const CommandNode*> dirty;
+  dirty.swap(m_dirtyRows);
+  m_refreshQueued = false;
+  m_refreshFrom = std::numeric_limits<int>::max();
+
+  auto affected = [&](CommandNode* n) {
+    return dirty.contains(n)
+           || (from != std::numeric_limits<int>::max()
+               && m_model->globalOrder(n, /*includeStart=*/true) >= from);
   };
-  rec(QModelIndex());
+
+  const int bottom = viewport()->height();
+  for (QModelIndex idx = indexAt(QPoint(1, 1)); idx.isValid(); idx = indexBelow(idx)) {
+    const QRect r = visualRect(idx);
+    if (r.top() >= bottom) {
+      break;
+    }
+    CommandNode* n = m_model->nodeFromIndex(idx);
+    if (!affected(n)) {
+      continue;
+    }
+    if (!m_rowWidgets) {
+      viewport()->update(QRect(0, r.top(), viewport()->width(), r.height()));
+    } else if (CommandRowWidget* w = m_boundRows.value(n)) {
+      w->setContext(idx, m_model); // the row may have moved
+    }
+  }
+}
+
+// Global position of the row just before `row` under `parent`, or of the
+// parent itself when `row` is its first child.
+int CommandTreeView::orderBefore(const QModelIndex& parent, int row) const {
+  const int rows = m_model->rowCount(parent);
+  if (row > 0 && rows > 0) {
+    return m_model->globalOrder(m_model->index(std::min(row, rows) - 1, 0, parent), true);
+  }
+  return parent.isValid() ? m_model->globalOrder(parent, true) : 0;
 }
 
 }
@@ -3,14 +3,18 @@
 
 #include <QTreeView>
 #include <QMenu>
+#include <QHash>
 #include <QMap>
+#include <QSet>
 #include <functional>
+#include <limits>
 #include "commandmodel.h"
 #include "rowdelegate.h"
 
 namespace rp {
 
-using CommandFactory = std::function<CommandPtr()>;
+class CommandRowWidget;
+class CommandSearchIndex;
 
 class CommandTreeView : public QTreeView {
   Q_OBJECT
@@ -23,6 +27,25 @@ public:
   void registerCommandType(const QString& typeName, CommandFactory factory);
   void addAtRoot(CommandPtr cmd);
   void addChildAtSelection(rp::CommandPtr cmd);
+  void addAtRoot(const std::vector<CommandPtr>& cmds);
+  void addChildrenAtSelection(const std::vector<CommandPtr>& cmds);
+  void jumpToCommand(int number);
+
+  // Rows are painted by RowDelegate by default. With row widgets every
+  // row in the viewport gets a CommandRowWidget from a recycling pool, so
+  // their number is bounded by the viewport height.
+  void setRowWidgets(bool enabled);
+  bool rowWidgets() const { return m_rowWidgets; }
+
+public slots:
+  // Highlights the row of the command with Command::id() `commandId` (0 or
+  // an id no longer in the model clears it), e.g. the command an
+  // ExecutionEngine is running.
+  void setActiveCommand(quint64 commandId);
+  // Shows only rows matching `text` (see CommandSearchIndex) and their
+  // enclosing blocks; an empty text shows everything again. Pending rows are
+  // searched in their source and only fetched where they hold matches.
+  void setFilterText(const QString& text);
 
 signals:
   void commandClicked(rp::Command* cmd);
@@ -33,20 +56,55 @@ signals:
 
 protected:
   void mousePressEvent(QMouseEvent* e) override;
+  void scrollContentsBy(int dx, int dy) override;
+  void updateGeometries() override;
 
 
 private slots:
   void onCustomContextMenuRequested(const QPoint& pos);
-  void refreshAllRows();
 
 private:
   // void buildDemoData();
-  void openEditorsRecursively(const QModelIndex& parent);
+  void scheduleRowLayout();
+  void layoutRowWidgets();
+  CommandRowWidget* takeRowWidget();
+  CommandRowWidget* rowWidget(const QModelIndex& idx) const;
+  void dispatchRowAction(const QModelIndex& idx, rp::RowAction action);
+  QList<QPersistentModelIndex> actionTargets(const QModelIndex& idx) const;
+  static QModelIndexList toIndexList(const QList<QPersistentModelIndex>& indexes);
+  void emitMoved(const std::vector<Command*>& moved);
+  void scheduleRefreshFrom(int order);
+  void markRowDirty(const QModelIndex& idx);
+  void markAncestorsDirty(const QModelIndex& parent);
+  void scheduleRefresh();
+  void flushRefresh();
+  int orderBefore(const QModelIndex& parent, int row) const;
   void userClickedOutsideRowItems();
+  void applyFilter();
+  void scheduleFilterReset();
+  void hideRow(const QModelIndex& idx, bool hide);
 
   CommandModel* m_model {nullptr};
+  RowDelegate* m_delegate {nullptr};
+  bool m_rowWidgets {false};
+  bool m_rowLayoutQueued {false};
+  QHash<const CommandNode*, CommandRowWidget*> m_boundRows; // rows in the viewport
+  std::vector<CommandRowWidget*> m_spareRows;                // hidden, ready to rebind
   QMenu* m_ctxMenu {nullptr};
   QMap<QString, CommandFactory> m_registry; // typeName -> factory
+  bool m_refreshQueued {false};
+  int m_refreshFrom {std::numeric_limits<int>::max()}; // global order, Start included
+  QSet<const CommandNode*> m_dirtyRows;
+  QPersistentModelIndex m_activeRow;
+
+  // filter state: only the rows whose visibility changed are touched per
+  // keystroke
+  CommandSearchIndex* m_search {nullptr};
+  QString m_filter;
+  bool m_filtering {false};      // top-level rows outside m_filterVisible are hidden
+  bool m_filterReset {false};    // structure changed, start over on next apply
+  QSet<CommandNode*> m_filterVisible;
+  QList<QPersistentModelIndex> m_filterHidden;
 };
 
 }
@@ -0,0 +1,175 @@
+#include "executionengine.h"
+#include "commandmodel.h"
+#include "programcompiler.h"
+#include <QGuiApplication>
+#include <QScreen>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace rp {
+
+ExecutionEngine::ExecutionEngine(CommandModel* model, QObject* parent)
+    : QObject(parent)
+    , m_compiler(new ProgramCompiler(model, this))
+    , m_poll(new QTimer(this)) {
+  // one sample per frame
+  const QScreen* screen = QGuiApplication::primaryScreen();
+  const qreal hz = screen ? screen->refreshRate() : 60.0;
+  m_poll->setInterval(std::max(1, int(1000.0 / (hz > 0 ? hz : 60.0))));
+  m_poll->setTimerType(Qt::PreciseTimer);
+  connect(m_poll, &QTimer::timeout, this, &ExecutionEngine::poll);
+}
+
+ExecutionEngine::~ExecutionEngine() {
+  if (m_thread) {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_mode = Mode::Stop;
+    }
+    m_wake.notify_all();
+    m_thread->wait();
+    delete m_thread;
+  }
+}
+
+void ExecutionEngine::run() {
+  if (m_state == State::Idle) {
+    launch(Mode::Run);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_mode = Mode::Run;
+  }
+  m_wake.notify_all();
+  setState(State::Running);
+}
+
+void ExecutionEngine::step() {
+  if (m_state == State::Idle) {
+    m_steps = 1;
+    launch(Mode::Pause);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_mode = Mode::Pause;
+    ++m_steps;
+  }
+  m_wake.notify_all();
+  setState(State::Paused);
+}
+
+void ExecutionEngine::pause() {
+  if (m_state != State::Running) return;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_mode = Mode::Pause;
+  }
+  m_wake.notify_all();
+  setState(State::Paused);
+}
+
+void ExecutionEngine::stop() {
+  if (m_state == State::Idle) return;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_mode = Mode::Stop;
+  }
+  m_wake.notify_all();
+  // state goes back to Idle when the worker has left
+}
+
+bool ExecutionEngine::launch(Mode mode) {
+  if (m_thread) return false;
+  m_program = m_compiler->program();
+  m_mode = mode;
+  m_pc.store(-1);
+  m_shownPc = -1;
+
+  BytecodePtr program = m_program;
+  m_thread = QThread::create([this, program]{ execute(program); });
+  connect(m_thread, &QThread::finished, this, [this]{
+    m_thread->deleteLater();
+    m_thread = nullptr;
+    m_poll->stop();
+    m_steps = 0;
+    m_shownPc = -1;
+    m_program.reset();
+    emit currentCommandChanged(0);
+    setState(State::Idle);
+    emit finished();
+  });
+  m_thread->start();
+  m_poll->start();
+  setState(mode == Mode::Run ? State::Running : State::Paused);
+  return true;
+}
+
+// Simulated delay; false if stopped meanwhile. Pausing mid-move finishes the
+// move first.
+bool ExecutionEngine::waitFor(double seconds) {
+  std::unique_lock<std::mutex> lock(m_lock);
+  const auto d = std::chrono::duration<double>(seconds / m_timeScale.load());
+  m_wake.wait_for(lock, d, [this]{ return m_mode == Mode::Stop; });
+  return m_mode != Mode::Stop;
+}
+
+// Worker thread. Reads only the immutable program and the control block.
+void ExecutionEngine::execute(BytecodePtr program) {
+  const std::vector<Instruction>& code = program->code;
+  double px = 0, py = 0, pz = 0; // simulated tool position
+  int32_t pc = 0;
+
+  while (pc >= 0 && pc < int32_t(code.size())) {
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_wake.wait(lock, [this]{ return m_mode != Mode::Pause || m_steps > 0; });
+      if (m_mode == Mode::Stop) break;
+      if (m_mode == Mode::Pause) --m_steps;
+    }
+
+    const Instruction& ins = code[pc];
+    if (ins.op == OpCode::End) break;
+    m_pc.store(pc, std::memory_order_release);
+
+    switch (ins.op) {
+    case OpCode::MoveL: {
+      const MotionRecord& m = program->motions[ins.arg];
+      const double dist = std::sqrt((m.x - px) * (m.x - px) + (m.y - py) * (m.y - py)
+                                    + (m.z - pz) * (m.z - pz));
+      px = m.x; py = m.y; pz = m.z;
+      if (m.speed > 0 && !waitFor(dist / m.speed)) return;
+      ++pc;
+      break;
+    }
+    case OpCode::JumpIfNot:
+      ++pc; // condition always holds in a dry run
+      break;
+    default:
+      ++pc;
+      break;
+    }
+  }
+}
+
+void ExecutionEngine::setState(State s) {
+  if (m_state == s) return;
+  m_state = s;
+  emit stateChanged(s);
+}
+
+// GUI side of the mailbox: publish the latest instruction, drop the ones
+// that came and went between two frames.
+void ExecutionEngine::poll() {
+  const int32_t pc = m_pc.load(std::memory_order_acquire);
+  if (pc != m_shownPc && m_program) {
+    m_shownPc = pc;
+    emit currentCommandChanged(pc >= 0 ? m_program->source[pc] : 0);
+  }
+}
+
+}
@@ -0,0 +1,87 @@
+#ifndef EXECUTIONENGINE_H
+#define EXECUTIONENGINE_H
+
+#include <QObject>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "bytecode.h"
+
+class QThread;
+class QTimer;
+
+namespace rp {
+
+class CommandModel;
+class ProgramCompiler;
+
+/**
+ * Execution engine
+ * Dry-runs the compiled program (see ProgramCompiler) on a worker thread
+ * with simulated motion timing: a MoveL takes distance / speed, scaled by
+ * timeScale(). If conditions are not modelled and always enter their block.
+ *
+ * The worker only publishes the current instruction into an atomic slot;
+ * the GUI samples it at the display refresh rate, so no matter how many
+ * commands run per second the event queue sees at most one update per frame.
+*/
+class ExecutionEngine : public QObject {
+  Q_OBJECT
+public:
+  enum class State { Idle, Running, Paused };
+  Q_ENUM(State)
+
+  explicit ExecutionEngine(CommandModel* model, QObject* parent = nullptr);
+  ~ExecutionEngine() override;
+
+  State state() const { return m_state; }
+
+  // Simulated seconds per real second (2.0 = twice as fast).
+  void setTimeScale(double scale) { m_timeScale.store(scale > 0 ? scale : 1.0); }
+  double timeScale() const { return m_timeScale.load(); }
+
+public slots:
+  void run();
+  void step();
+  void pause();
+  void stop();
+
+signals:
+  void stateChanged(rp::ExecutionEngine::State state);
+  // Throttled to the refresh rate; Command::id() of the running command, 0
+  // when nothing is running. Resolve with CommandModel::findIndexById(): the
+  // command may have been deleted since.
+  void currentCommandChanged(quint64 commandId);
+  void finished();
+
+private:
+  enum class Mode { Run, Pause, Stop };
+
+  bool launch(Mode mode);
+  void execute(BytecodePtr program);
+  bool waitFor(double seconds);
+  void setState(State s);
+  void poll();
+
+  ProgramCompiler* m_compiler;
+  QThread* m_thread {nullptr};
+  QTimer* m_poll;
+  BytecodePtr m_program;
+  State m_state {State::Idle};
+
+  // worker control, guarded by m_lock
+  std::mutex m_lock;
+  std::condition_variable m_wake;
+  Mode m_mode {Mode::Pause};
+  int m_steps {0};
+
+  // worker -> GUI mailbox
+  std::atomic<int32_t> m_pc {-1};
+  int32_t m_shownPc {-1};
+
+  std::atomic<double> m_timeScale {1.0};
+};
+
+}
+
+#endif // EXECUTIONENGINE_H
@@ -0,0 +1,64 @@
+#include "flatcommandtree.h"
+
+namespace rp {
+
+void FlatCommandTree::clear() {
+  m_parent.clear();
+  m_firstChild.clear();
+  m_nextSibling.clear();
+  m_subtreeSize.clear();
+  m_depth.clear();
+  m_type.clear();
+  m_command.clear();
+  m_node.clear();
+}
+
+// Iterative pre-order walk of everything under `root` (root itself excluded).
+// Node subtree sizes also count rows still pending in a ChildSource, which
+// have no slot here, so sizes and next-sibling links are filled in from the
+// slots actually written: a slot's next sibling when that sibling is written,
+// its subtree size when its frame is popped.
+void FlatCommandTree::build(const CommandNode* root) {
+  clear();
+  if (!root) {
+    return;
+  }
+
+  struct Frame { const CommandNode* node; int32_t slot; int next; int32_t lastChild; };
+  std::vector<Frame> stack;
+  stack.push_back({root, kNone, 0, kNone});
+
+  while (!stack.empty()) {
+    Frame& f = stack.back();
+    if (f.next >= f.node->childCount()) {
+      if (f.slot != kNone) {
+        m_subtreeSize[f.slot] = static_cast<int32_t>(m_node.size()) - f.slot;
+      }
+      stack.pop_back();
+      continue;
+    }
+    const int childRow = f.next++;
+    CommandNode* c = f.node->child(childRow);
+    const int32_t slot = static_cast<int32_t>(m_node.size());
+    if (f.lastChild != kNone) {
+      m_nextSibling[f.lastChild] = slot;
+    }
+    f.lastChild = slot;
+
+    m_parent.push_back(f.slot);
+    m_firstChild.push_back(c->childCount() > 0 ? slot + 1 : kNone);
+    m_nextSibling.push_back(kNone);
+    m_subtreeSize.push_back(1);
+    m_depth.push_back(static_cast<uint16_t>(stack.size() - 1));
+    m_type.push_back(static_cast<uint8_t>(c->command() ? c->command()->type()
+                                                         : Command::Type::Base));
+    m_command.push_back(c->command().get());
+    m_node.push_back(c);
+
+    if (c->childCount() > 0) {
+      stack.push_back({c, slot, 0, kNone});
+    }
+  }
+}
+
+}
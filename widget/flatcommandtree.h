@@ -0,0 +1,69 @@
+#ifndef FLATCOMMANDTREE_H
+#define FLATCOMMANDTREE_H
+
+#include <cstdint>
+#include <vector>
+#include "commandnode.h"
+
+namespace rp {
+
+/**
+ * Flat command tree
+ * Structure-of-arrays mirror of a CommandNode tree in depth-first pre-order.
+ * Slot i is the i-th command of the program (Start included), so ordering,
+ * search, export and validation become linear scans over contiguous arrays
+ * instead of pointer chasing. Slots are only stable until the next
+ * structural change; CommandModel rebuilds the mirror lazily.
+*/
+class FlatCommandTree {
+public:
+  static constexpr int32_t kNone = -1;
+
+  void build(const CommandNode* root);
+  void clear();
+
+  int size() const { return static_cast<int>(m_node.size()); }
+  bool isEmpty() const { return m_node.empty(); }
+
+  // topology, all slots are pre-order positions
+  int32_t parent(int slot) const { return m_parent[slot]; }
+  int32_t firstChild(int slot) const { return m_firstChild[slot]; }
+  int32_t nextSibling(int slot) const { return m_nextSibling[slot]; }
+  int32_t subtreeEnd(int slot) const { return slot + m_subtreeSize[slot]; }
+  int32_t subtreeSize(int slot) const { return m_subtreeSize[slot]; }
+  uint16_t depth(int slot) const { return m_depth[slot]; }
+  Command::Type type(int slot) const { return static_cast<Command::Type>(m_type[slot]); }
+
+  Command* command(int slot) const { return m_command[slot]; }
+  CommandNode* node(int slot) const { return m_node[slot]; }
+
+  // raw arrays for tight loops
+  const std::vector<int32_t>& parents() const { return m_parent; }
+  const std::vector<uint16_t>& depths() const { return m_depth; }
+  const std::vector<uint8_t>& types() const { return m_type; }
+  const std::vector<Command*>& commands() const { return m_command; }
+
+  // First slot >= from whose command satisfies pred, or kNone.
+  template <class Pred>
+  int32_t findNext(int from, Pred pred) const {
+    const int n = size();
+    for (int i = from < 0 ? 0 : from; i < n; ++i) {
+      if (m_command[i] && pred(*m_command[i])) return i;
+    }
+    return kNone;
+  }
+
+private:
+  std::vector<int32_t> m_parent;
+  std::vector<int32_t> m_firstChild;
+  std::vector<int32_t> m_nextSibling;
+  std::vector<int32_t> m_subtreeSize;
+  std::vector<uint16_t> m_depth;
+  std::vector<uint8_t> m_type;
+  std::vector<Command*> m_command;
+  std::vector<CommandNode*> m_node;
+};
+
+}
+
+#endif // FLATCOMMANDTREE_H
@@ -0,0 +1,36 @@
+#include "movelarrays.h"
+
+namespace rp {
+
+void MoveLArrays::build(const FlatCommandTree& flat) {
+  m_x.clear(); m_y.clear(); m_z.clear(); m_speed.clear();
+  m_command.clear();
+  m_index.clear();
+
+  const std::vector<uint8_t>& types = flat.types();
+  const int n = flat.size();
+  for (int slot = 0; slot < n; ++slot) {
+    if (types[slot] != uint8_t(Command::Type::MoveL)) continue;
+    Command* c = flat.command(slot);
+    if (!c || c->paramCount() < 4) continue;
+    m_index.insert(c, size());
+    m_command.push_back(c);
+    m_x.push_back(c->param(0));
+    m_y.push_back(c->param(1));
+    m_z.push_back(c->param(2));
+    m_speed.push_back(c->param(3));
+  }
+}
+
+bool MoveLArrays::update(const Command* c) {
+  auto it = m_index.constFind(c);
+  if (it == m_index.constEnd()) return false;
+  const int i = it.value();
+  m_x[i] = c->param(0);
+  m_y[i] = c->param(1);
+  m_z[i] = c->param(2);
+  m_speed[i] = c->param(3);
+  return true;
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef MOVELARRAYS_H
+#define MOVELARRAYS_H
+
+#include <QHash>
+#include <vector>
+#include "flatcommandtree.h"
+#include "movelkernels.h"
+
+namespace rp {
+
+/**
+ * MoveL arrays
+ * Every MoveL target of the program in program order, one contiguous array
+ * per coordinate so the movel:: kernels can stream them. CommandModel keeps
+ * it in sync: rebuilt from the flat tree after structural changes, patched
+ * entry by entry after parameter edits.
+*/
+class MoveLArrays {
+public:
+  void build(const FlatCommandTree& flat);
+  // Re-reads one command's parameters; false if it is not a known MoveL.
+  bool update(const Command* c);
+
+  int size() const { return static_cast<int>(m_x.size()); }
+  const double* x() const { return m_x.data(); }
+  const double* y() const { return m_y.data(); }
+  const double* z() const { return m_z.data(); }
+  const double* speed() const { return m_speed.data(); }
+  Command* command(int i) const { return m_command[i]; }
+
+  double pathLength() const { return movel::pathLength(x(), y(), z(), m_x.size()); }
+  movel::Bounds bounds() const { return movel::bounds(x(), y(), z(), m_x.size()); }
+  double maxStep() const { return movel::maxStep(x(), y(), z(), m_x.size()); }
+
+private:
+  std::vector<double> m_x, m_y, m_z, m_speed;
+  std::vector<Command*> m_command;
+  QHash<const Command*, int> m_index;
+};
+
+}
+
+#endif // MOVELARRAYS_H
@@ -0,0 +1,180 @@
+#include "movelkernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if !defined(RP_NO_SIMD)
+#  if defined(__AVX__)
+#    define RP_MOVEL_AVX 1
+#    include <immintrin.h>
+#  elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define RP_MOVEL_SSE2 1
+#    include <emmintrin.h>
+#  endif
+#endif
+
+namespace rp {
+namespace movel {
+
+namespace {
+
+inline double segment(const double* x, const double* y, const double* z, std::size_t i) {
+  const double dx = x[i + 1] - x[i], dy = y[i + 1] - y[i], dz = z[i + 1] - z[i];
+  return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+#ifdef RP_MOVEL_AVX
+constexpr std::size_t kLanes = 4;
+using Vec = __m256d;
+inline Vec load(const double* p) { return _mm256_loadu_pd(p); }
+inline void store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+inline Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+inline Vec vsqrt(Vec a) { return _mm256_sqrt_pd(a); }
+inline Vec vmin(Vec a, Vec b) { return _mm256_min_pd(a, b); }
+inline Vec vmax(Vec a, Vec b) { return _mm256_max_pd(a, b); }
+inline Vec splat(double v) { return _mm256_set1_pd(v); }
+inline int neqMask(Vec a, Vec b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_NEQ_UQ)); }
+#elif defined(RP_MOVEL_SSE2)
+constexpr std::size_t kLanes = 2;
+using Vec = __m128d;
+inline Vec load(const double* p) { return _mm_loadu_pd(p); }
+inline void store(double* p, Vec v) { _mm_storeu_pd(p, v); }
+inline Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+inline Vec vsqrt(Vec a) { return _mm_sqrt_pd(a); }
+inline Vec vmin(Vec a, Vec b) { return _mm_min_pd(a, b); }
+inline Vec vmax(Vec a, Vec b) { return _mm_max_pd(a, b); }
+inline Vec splat(double v) { return _mm_set1_pd(v); }
+inline int neqMask(Vec a, Vec b) { return _mm_movemask_pd(_mm_cmpneq_pd(a, b)); }
+#endif
+
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+inline double lanes(Vec v, double (*op)(double, double), double init) {
+  alignas(32) double tmp[kLanes];
+  store(tmp, v);
+  double r = init;
+  for (double t : tmp) r = op(r, t);
+  return r;
+}
+
+inline double plus(double a, double b) { return a + b; }
+inline double lower(double a, double b) { return std::min(a, b); }
+inline double higher(double a, double b) { return std::max(a, b); }
+
+inline Vec segmentVec(const double* x, const double* y, const double* z, std::size_t i) {
+  const Vec dx = sub(load(x + i + 1), load(x + i));
+  const Vec dy = sub(load(y + i + 1), load(y + i));
+  const Vec dz = sub(load(z + i + 1), load(z + i));
+  return vsqrt(add(add(mul(dx, dx), mul(dy, dy)), mul(dz, dz)));
+}
+#endif
+
+}
+
+void segmentLengths(const double* x, const double* y, const double* z, std::size_t n, double* out) {
+  if (n < 2) return;
+  const std::size_t segs = n - 1;
+  std::size_t i = 0;
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+  for (; i + kLanes <= segs; i += kLanes) {
+    store(out + i, segmentVec(x, y, z, i));
+  }
+#endif
+  for (; i < segs; ++i) out[i] = segment(x, y, z, i);
+}
+
+double pathLength(const double* x, const double* y, const double* z, std::size_t n) {
+  if (n < 2) return 0.0;
+  const std::size_t segs = n - 1;
+  std::size_t i = 0;
+  double total = 0.0;
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+  Vec acc = splat(0.0);
+  for (; i + kLanes <= segs; i += kLanes) {
+    acc = add(acc, segmentVec(x, y, z, i));
+  }
+  total = lanes(acc, plus, 0.0);
+#endif
+  for (; i < segs; ++i) total += segment(x, y, z, i);
+  return total;
+}
+
+Bounds bounds(const double* x, const double* y, const double* z, std::size_t n) {
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  Bounds b {inf, inf, inf, -inf, -inf, -inf, n == 0};
+  std::size_t i = 0;
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+  Vec lx = splat(inf), ly = splat(inf), lz = splat(inf);
+  Vec hx = splat(-inf), hy = splat(-inf), hz = splat(-inf);
+  for (; i + kLanes <= n; i += kLanes) {
+    const Vec vx = load(x + i), vy = load(y + i), vz = load(z + i);
+    lx = vmin(lx, vx); ly = vmin(ly, vy); lz = vmin(lz, vz);
+    hx = vmax(hx, vx); hy = vmax(hy, vy); hz = vmax(hz, vz);
+  }
+  b.minX = lanes(lx, lower, inf); b.minY = lanes(ly, lower, inf); b.minZ = lanes(lz, lower, inf);
+  b.maxX = lanes(hx, higher, -inf); b.maxY = lanes(hy, higher, -inf); b.maxZ = lanes(hz, higher, -inf);
+#endif
+  for (; i < n; ++i) {
+    b.minX = std::min(b.minX, x[i]); b.maxX = std::max(b.maxX, x[i]);
+    b.minY = std::min(b.minY, y[i]); b.maxY = std::max(b.maxY, y[i]);
+    b.minZ = std::min(b.minZ, z[i]); b.maxZ = std::max(b.maxZ, z[i]);
+  }
+  return b;
+}
+
+double maxStep(const double* x, const double* y, const double* z, std::size_t n) {
+  if (n < 2) return 0.0;
+  const std::size_t segs = n - 1;
+  std::size_t i = 0;
+  double best = 0.0;
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+  Vec acc = splat(0.0);
+  for (; i + kLanes <= segs; i += kLanes) {
+    acc = vmax(acc, segmentVec(x, y, z, i));
+  }
+  best = lanes(acc, higher, 0.0);
+#endif
+  for (; i < segs; ++i) best = std::max(best, segment(x, y, z, i));
+  return best;
+}
+
+std::size_t clampSpeeds(double* speed, std::size_t n, double lo, double hi) {
+  std::size_t changed = 0;
+  std::size_t i = 0;
+#if defined(RP_MOVEL_AVX) || defined(RP_MOVEL_SSE2)
+  const Vec vlo = splat(lo), vhi = splat(hi);
+  for (; i + kLanes <= n; i += kLanes) {
+    const Vec v = load(speed + i);
+    const Vec c = vmin(vmax(v, vlo), vhi);
+    const int mask = neqMask(v, c);
+    if (mask) {
+      store(speed + i, c);
+      for (int m = mask; m; m &= m - 1) ++changed;
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    const double c = std::min(std::max(speed[i], lo), hi);
+    if (c != speed[i]) {
+      speed[i] = c;
+      ++changed;
+    }
+  }
+  return changed;
+}
+
+const char* implementation() {
+#ifdef RP_MOVEL_AVX
+  return "avx";
+#elif defined(RP_MOVEL_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}
+}
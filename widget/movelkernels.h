@@ -0,0 +1,44 @@
+#ifndef MOVELKERNELS_H
+#define MOVELKERNELS_H
+
+#include <cstddef>
+
+namespace rp {
+
+/**
+ * MoveL kernels
+ * Geometry passes over structure-of-arrays MoveL targets (see MoveLArrays).
+ * Implementations use AVX when the compiler targets it (MSVC: /arch:AVX or
+ * /arch:AVX2), SSE2 otherwise on x86/x64, and plain loops elsewhere. Define
+ * RP_NO_SIMD to force the scalar path.
+*/
+namespace movel {
+
+struct Bounds {
+  double minX, minY, minZ;
+  double maxX, maxY, maxZ;
+  bool empty;
+};
+
+// out[i] = |p[i+1] - p[i]| for i < n - 1.
+void segmentLengths(const double* x, const double* y, const double* z, std::size_t n, double* out);
+
+// Sum of the segment lengths.
+double pathLength(const double* x, const double* y, const double* z, std::size_t n);
+
+Bounds bounds(const double* x, const double* y, const double* z, std::size_t n);
+
+// Longest single segment.
+double maxStep(const double* x, const double* y, const double* z, std::size_t n);
+
+// Clamps every speed into [lo, hi]; returns how many were changed.
+std::size_t clampSpeeds(double* speed, std::size_t n, double lo, double hi);
+
+// Name of the compiled-in implementation ("avx", "sse2" or "scalar").
+const char* implementation();
+
+}
+
+}
+
+#endif // MOVELKERNELS_H
@@ -0,0 +1,54 @@
+#include "nametable.h"
+#include <QHash>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+
+namespace rp {
+
+namespace {
+struct Pool {
+  std::shared_mutex lock;
+  std::deque<QString> names {QString()}; // index = id, 0 = kNone
+  QHash<QString, NameTable::Id> ids;
+};
+
+// Leaked on purpose, like the slab pools: commands may be destroyed during
+// static destruction.
+Pool& pool() {
+  static Pool* p = new Pool;
+  return *p;
+}
+}
+
+NameTable::Id NameTable::intern(const QString& name) {
+  if (name.isNull()) return kNone;
+  Pool& p = pool();
+  {
+    std::shared_lock<std::shared_mutex> read(p.lock);
+    auto it = p.ids.constFind(name);
+    if (it != p.ids.constEnd()) return it.value();
+  }
+  std::unique_lock<std::shared_mutex> write(p.lock);
+  auto it = p.ids.constFind(name); // another thread may have added it
+  if (it != p.ids.constEnd()) return it.value();
+  const Id id = Id(p.names.size());
+  p.names.push_back(name);
+  p.ids.insert(name, id);
+  return id;
+}
+
+NameTable::Id NameTable::find(const QString& name) {
+  if (name.isNull()) return kNone;
+  Pool& p = pool();
+  std::shared_lock<std::shared_mutex> read(p.lock);
+  return p.ids.value(name, kNone);
+}
+
+QString NameTable::name(Id id) {
+  Pool& p = pool();
+  std::shared_lock<std::shared_mutex> read(p.lock);
+  return id < p.names.size() ? p.names[id] : QString();
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+#include <QString>
+#include <QtGlobal>
+
+namespace rp {
+
+/**
+ * Name table
+ * Process-wide pool of interned command names. A command keeps a 32-bit
+ * handle instead of its own QString, equal names share one string, and both
+ * directions (name -> handle, handle -> name) are a hash or array lookup.
+ * Entries are never freed: names are few compared to commands. Thread-safe,
+ * loaders intern names off the GUI thread.
+*/
+class NameTable {
+public:
+  using Id = quint32;
+  static constexpr Id kNone = 0; // null name
+
+  // Handle of `name`, added if new; kNone for a null string.
+  static Id intern(const QString& name);
+  // Handle of `name` if it was ever interned, kNone otherwise.
+  static Id find(const QString& name);
+  static QString name(Id id);
+};
+
+}
+
+#endif // NAMETABLE_H
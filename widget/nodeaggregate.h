@@ -0,0 +1,159 @@
+#ifndef NODEAGGREGATE_H
+#define NODEAGGREGATE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "command.h"
+
+namespace rp {
+
+/**
+ * Node aggregate
+ * Totals of a subtree taken in program order: MoveL count, Cartesian path
+ * length between consecutive MoveL targets and the time to travel it at each
+ * target's speed. The first and last targets are kept so two adjacent
+ * summaries combine in O(1) (the segment joining them is added then), which
+ * lets CommandNode keep block totals in a ChildAggregateTree and recombine
+ * only the part an edit touched.
+*/
+struct NodeAggregate {
+  int moveCount {0};
+  double pathLength {0.0};    // mm
+  double estimatedTime {0.0}; // s
+  double firstX {0}, firstY {0}, firstZ {0}, firstSpeed {0};
+  double lastX {0}, lastY {0}, lastZ {0};
+
+  static NodeAggregate of(const Command* c) {
+    NodeAggregate a;
+    if (c && c->type() == Command::Type::MoveL && c->paramCount() >= 4) {
+      a.moveCount = 1;
+      a.firstX = a.lastX = c->param(0);
+      a.firstY = a.lastY = c->param(1);
+      a.firstZ = a.lastZ = c->param(2);
+      a.firstSpeed = c->param(3);
+    }
+    return a;
+  }
+
+  // this followed by `next`
+  void append(const NodeAggregate& next) {
+    if (next.moveCount == 0) {
+      return;
+    }
+    if (moveCount == 0) {
+      *this = next;
+      return;
+    }
+    const double dx = next.firstX - lastX, dy = next.firstY - lastY, dz = next.firstZ - lastZ;
+    const double joint = std::sqrt(dx * dx + dy * dy + dz * dz);
+    moveCount += next.moveCount;
+    pathLength += joint + next.pathLength;
+    estimatedTime += (next.firstSpeed > 0 ? joint / next.firstSpeed : 0.0) + next.estimatedTime;
+    lastX = next.lastX;
+    lastY = next.lastY;
+    lastZ = next.lastZ;
+  }
+};
+
+/**
+ * Child aggregate tree
+ * Totals of a node's children: one summary per chunk of kChunk rows, combined
+ * pairwise in a segment tree. Editing a row recombines its chunk and the
+ * log(chunks) sums above it; inserting, removing or moving rows rebuilds it.
+*/
+class ChildAggregateTree {
+public:
+  static constexpr int kChunk = 32;
+
+  // After a structural change. Returns whether everything was stale already.
+  bool invalidateAll() {
+    const bool was = m_allStale;
+    m_allStale = true;
+    return was;
+  }
+
+  // After the totals of child `row` changed. Returns whether its chunk was
+  // stale already.
+  bool invalidate(int row) {
+    if (m_allStale) {
+      return true;
+    }
+    if (row < 0 || row >= m_rows) {
+      return invalidateAll();
+    }
+    const int c = row / kChunk;
+    if (m_chunkStale[c]) {
+      return true;
+    }
+    m_chunkStale[c] = 1;
+    m_stale.push_back(c);
+    return false;
+  }
+
+  // Totals of `rows` children; `aggregateOf(row)` gives one child's totals.
+  template <class AggregateOf>
+  const NodeAggregate& total(int rows, AggregateOf aggregateOf) {
+    if (m_allStale || rows != m_rows) {
+      rebuild(rows, aggregateOf);
+    } else {
+      for (int c : m_stale) {
+        m_chunkStale[c] = 0;
+        m_tree[m_leaves + c] = chunk(c, aggregateOf);
+        for (int i = (m_leaves + c) / 2; i >= 1; i /= 2) {
+          m_tree[i] = combine(m_tree[2 * i], m_tree[2 * i + 1]);
+        }
+      }
+      m_stale.clear();
+    }
+    return m_tree[1];
+  }
+
+private:
+  static NodeAggregate combine(NodeAggregate a, const NodeAggregate& b) {
+    a.append(b);
+    return a;
+  }
+
+  template <class AggregateOf>
+  NodeAggregate chunk(int c, AggregateOf& aggregateOf) const {
+    NodeAggregate a;
+    const int end = std::min(m_rows, (c + 1) * kChunk);
+    for (int r = c * kChunk; r < end; ++r) {
+      a.append(aggregateOf(r));
+    }
+    return a;
+  }
+
+  template <class AggregateOf>
+  void rebuild(int rows, AggregateOf& aggregateOf) {
+    m_rows = rows;
+    const int chunks = (rows + kChunk - 1) / kChunk;
+    m_leaves = 1;
+    while (m_leaves < chunks) {
+      m_leaves *= 2;
+    }
+    m_tree.assign(2 * m_leaves, NodeAggregate());
+    for (int c = 0; c < chunks; ++c) {
+      m_tree[m_leaves + c] = chunk(c, aggregateOf);
+    }
+    for (int i = m_leaves - 1; i >= 1; --i) {
+      m_tree[i] = combine(m_tree[2 * i], m_tree[2 * i + 1]);
+    }
+    m_chunkStale.assign(chunks, 0);
+    m_stale.clear();
+    m_allStale = false;
+  }
+
+  std::vector<NodeAggregate> m_tree; // 1-based; chunk c at m_leaves + c
+  std::vector<uint8_t> m_chunkStale;
+  std::vector<int> m_stale;          // chunks to recombine
+  int m_rows {0};
+  int m_leaves {1};
+  bool m_allStale {true};
+};
+
+}
+
+#endif // NODEAGGREGATE_H
@@ -0,0 +1,170 @@
+#include "programcompiler.h"
+#include "commandmodel.h"
+
+namespace rp {
+
+ProgramCompiler::ProgramCompiler(CommandModel* model, QObject* parent)
+    : QObject(parent), m_model(model) {
+  connect(model, &QAbstractItemModel::dataChanged, this,
+          [this](const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                 const QList<int>& roles) {
+            if (CommandModel::isDiagnosticsOnly(roles)) return;
+            for (int r = topLeft.row(); r <= bottomRight.row(); ++r) {
+              CommandNode* n = m_model->nodeFromIndex(m_model->index(r, 0, topLeft.parent()));
+              dropFragment(n);
+              if (m_program && n) m_edited.insert(n);
+            }
+          });
+  connect(model, &QAbstractItemModel::rowsInserted, this,
+          [this](const QModelIndex& parent) { markDirty(parent); });
+  connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+          [this](const QModelIndex& parent, int first, int last) {
+            dropTopLevel(parent, first, last);
+            markDirty(parent);
+          });
+  connect(model, &QAbstractItemModel::rowsAboutToBeMoved, this,
+          [this](const QModelIndex& srcParent, int first, int last, const QModelIndex& dstParent) {
+            // a top-level block moving into another block stops being a fragment
+            dropTopLevel(srcParent, first, last);
+            markDirty(srcParent);
+            markDirty(dstParent);
+          });
+  auto dropAll = [this]{ m_fragments.clear(); m_program.reset(); m_edited.clear(); };
+  connect(model, &QAbstractItemModel::modelAboutToBeReset, this, dropAll);
+  connect(model, &QAbstractItemModel::layoutChanged, this, dropAll);
+}
+
+// Invalid index = the top-level list itself changed: fragments stay valid,
+// only the link step is redone.
+void ProgramCompiler::markDirty(const QModelIndex& idx) {
+  m_program.reset();
+  m_edited.clear();
+  dropFragment(m_model->nodeFromIndex(idx));
+}
+
+void ProgramCompiler::dropFragment(CommandNode* n) {
+  if (!n) return;
+  while (n->parent() && n->parent()->parent()) n = n->parent();
+  m_fragments.remove(n);
+}
+
+// Rewrites the instructions of edited rows in the linked image; false when
+// a row can't be located and the image has to be relinked.
+bool ProgramCompiler::patch() {
+  if (m_program.use_count() > 1) {
+    // handed out already: readers keep the old image
+    m_program = std::make_shared<Bytecode>(*m_program);
+  }
+  Bytecode& bc = *m_program;
+  for (CommandNode* n : std::as_const(m_edited)) {
+    const Command* c = n->command().get();
+    const int pc = m_model->globalOrder(n, /*includeStart=*/true);
+    if (!c || pc < 0 || std::size_t(pc) >= bc.source.size() || bc.source[pc] != c->id()) {
+      return false;
+    }
+    const Instruction& ins = bc.code[pc];
+    if (ins.op == OpCode::MoveL) {
+      bc.motions[ins.arg] = {c->param(0), c->param(1), c->param(2), c->param(3)};
+    }
+  }
+  m_edited.clear();
+  bc.dataRevision = m_model->dataRevision();
+  return true;
+}
+
+// Called before top-level rows leave: their nodes may be freed and the
+// address reused by the pool.
+void ProgramCompiler::dropTopLevel(const QModelIndex& parent, int first, int last) {
+  if (parent.isValid()) return;
+  for (int r = first; r <= last; ++r) {
+    m_fragments.remove(m_model->nodeFromIndex(m_model->index(r, 0, parent)));
+  }
+}
+
+void ProgramCompiler::compile(const CommandNode* node, Fragment& out) {
+  const Command* c = node->command().get();
+  if (!c) return;
+
+  Instruction ins {};
+  switch (c->type()) {
+  case Command::Type::Start:
+    ins.op = OpCode::Start;
+    break;
+  case Command::Type::MoveL:
+    ins.op = OpCode::MoveL;
+    ins.arg = int32_t(out.motions.size());
+    out.motions.push_back({c->param(0), c->param(1), c->param(2), c->param(3)});
+    break;
+  case Command::Type::If:
+    ins.op = OpCode::JumpIfNot; // arg patched once the block is emitted
+    break;
+  default:
+    ins.op = OpCode::Exec;
+    break;
+  }
+
+  const std::size_t pc = out.code.size();
+  out.code.push_back(ins);
+  out.source.push_back(c->id());
+
+  for (int i = 0; i < node->childCount(); ++i) {
+    compile(node->child(i), out);
+  }
+  if (ins.op == OpCode::JumpIfNot) {
+    out.code[pc].arg = int32_t(out.code.size() - pc - 1);
+  }
+}
+
+BytecodePtr ProgramCompiler::program() {
+  // fetching resets m_program through rowsInserted
+  m_model->fetchAll(QModelIndex(), /*recursive=*/true);
+  if (m_program && !m_edited.isEmpty() && !patch()) {
+    m_program.reset();
+    m_edited.clear();
+  }
+  if (m_program) {
+    return m_program;
+  }
+
+  const int rows = m_model->rowCount(QModelIndex());
+  std::vector<const CommandNode*> blocks;
+  blocks.reserve(rows);
+  std::size_t codeSize = 1, motionSize = 0;
+  for (int r = 0; r < rows; ++r) {
+    const CommandNode* n = m_model->nodeFromIndex(m_model->index(r, 0, QModelIndex()));
+    auto it = m_fragments.find(n);
+    if (it == m_fragments.end()) {
+      it = m_fragments.insert(n, Fragment{});
+      compile(n, it.value());
+    }
+    blocks.push_back(n);
+    codeSize += it->code.size();
+    motionSize += it->motions.size();
+  }
+
+  // link: concatenate, rebasing motion indices (jumps are relative)
+  auto bc = std::make_shared<Bytecode>();
+  bc->code.reserve(codeSize);
+  bc->source.reserve(codeSize);
+  bc->motions.reserve(motionSize);
+  for (const CommandNode* n : blocks) {
+    const Fragment& f = *m_fragments.constFind(n);
+    const int32_t base = int32_t(bc->motions.size());
+    for (Instruction ins : f.code) {
+      if (ins.op == OpCode::MoveL) ins.arg += base;
+      bc->code.push_back(ins);
+    }
+    bc->source.insert(bc->source.end(), f.source.begin(), f.source.end());
+    bc->motions.insert(bc->motions.end(), f.motions.begin(), f.motions.end());
+  }
+  bc->code.push_back(Instruction{OpCode::End, {}, 0});
+  bc->source.push_back(0);
+  Q_ASSERT(bc->code.size() == std::size_t(m_model->flatTree().size()) + 1); // every row, then End
+  bc->structureRevision = m_model->structureRevision();
+  bc->dataRevision = m_model->dataRevision();
+
+  m_program = std::move(bc);
+  return m_program;
+}
+
+}
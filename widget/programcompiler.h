@@ -0,0 +1,57 @@
+#ifndef PROGRAMCOMPILER_H
+#define PROGRAMCOMPILER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include "bytecode.h"
+
+namespace rp {
+
+class CommandModel;
+class CommandNode;
+
+/**
+ * Program compiler
+ * Keeps a Bytecode image of a CommandModel up to date. Every top-level block
+ * compiles to a position-independent fragment that is cached until a row in
+ * it is inserted, removed, moved or edited.
+ * Parameter edits keep the shape of the program and are patched into the
+ * linked image in place (one globalOrder() lookup per edited row). Any
+ * structural change recompiles the touched blocks but relinks the whole
+ * image, which copies every fragment: O(program size) per program() call.
+ * Rows still pending in a ChildSource are fetched first: the image always
+ * covers the whole program.
+*/
+class ProgramCompiler : public QObject {
+  Q_OBJECT
+public:
+  explicit ProgramCompiler(CommandModel* model, QObject* parent = nullptr);
+
+  // Same object until the model changes; an image is never modified while
+  // a caller holds it. GUI thread only; the result may be read from any
+  // thread.
+  BytecodePtr program();
+
+private:
+  struct Fragment {
+    std::vector<Instruction> code;
+    std::vector<MotionRecord> motions; // MoveL args are fragment-relative
+    std::vector<quint64> source;
+  };
+
+  static void compile(const CommandNode* node, Fragment& out);
+  void markDirty(const QModelIndex& idx);
+  void dropFragment(CommandNode* n);
+  bool patch();
+  void dropTopLevel(const QModelIndex& parent, int first, int last);
+
+  CommandModel* m_model;
+  QHash<const CommandNode*, Fragment> m_fragments; // clean top-level blocks
+  std::shared_ptr<Bytecode> m_program;
+  QSet<CommandNode*> m_edited; // rows to patch into m_program
+};
+
+}
+
+#endif // PROGRAMCOMPILER_H
@@ -0,0 +1,331 @@
+#include "programfile.h"
+#include "commandmodel.h"
+#include "commandnode.h"
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <cstring>
+
+namespace rp {
+
+namespace {
+
+constexpr char kMagic[4] = {'R', 'P', 'R', 'G'};
+constexpr quint32 kByteOrderMark = 0x01020304;
+constexpr qint32 kNoName = -1;
+
+// Node records start right after the header.
+struct FileHeader {
+  char magic[4];
+  quint32 version;
+  quint32 byteOrder;
+  quint32 nodeCount;
+  quint32 paramCount;
+  quint32 stringCount;
+  quint32 topLevelCount;        // records with parent -1
+  quint32 reserved;
+  quint64 paramsOffset;
+  quint64 stringOffsetsOffset;  // stringCount + 1 entries, in UTF-16 units
+  quint64 stringDataOffset;
+  quint64 stringDataSize;       // UTF-16 units
+};
+static_assert(sizeof(FileHeader) == 64, "FileHeader layout");
+
+struct NodeRecord {
+  qint32 parent;        // record index, -1 at top level
+  qint32 subtreeSize;   // this record + descendants
+  qint32 childCount;
+  quint32 typeName;     // string index
+  qint32 name;          // string index, kNoName for a generated name
+  quint32 firstParam;
+  quint16 paramCount;
+  quint8 type;          // Command::Type, for flat readers
+  quint8 reserved0;
+  quint32 reserved1;
+};
+static_assert(sizeof(NodeRecord) == 32, "NodeRecord layout");
+
+void setError(QString* error, const QString& msg) {
+  if (error) *error = msg;
+}
+
+template <class T>
+void appendRaw(QByteArray& out, const T* data, std::size_t count) {
+  out.append(reinterpret_cast<const char*>(data), static_cast<qsizetype>(count * sizeof(T)));
+}
+
+// Read-only view of a mapped file shared by every source built from it.
+struct MappedProgram {
+  QFile file;
+  const FileHeader* header {nullptr};
+  const NodeRecord* nodes {nullptr};
+  const double* params {nullptr};
+  const quint32* stringOffsets {nullptr};
+  const char16_t* stringData {nullptr};
+  QHash<quint32, QString> decoded; // type names repeat, decode each once
+
+  // `i` and its offsets were checked by load()
+  QString string(quint32 i) const {
+    const quint32 begin = stringOffsets[i];
+    return QString(reinterpret_cast<const QChar*>(stringData + begin), stringOffsets[i + 1] - begin);
+  }
+
+  const QString& typeName(quint32 i) {
+    auto it = decoded.find(i);
+    if (it == decoded.end()) it = decoded.insert(i, string(i));
+    return it.value();
+  }
+};
+
+// Children of record `owner` (-1 for the top level), walked by subtree-size
+// jumps. The owner's descendants are the records right after it, so what is
+// left is always the contiguous range [m_next, m_end). Records were
+// validated by load().
+class MappedChildSource : public ChildSource {
+public:
+  MappedChildSource(std::shared_ptr<MappedProgram> program, qint32 owner, int count)
+      : m_program(std::move(program)), m_owner(owner), m_next(quint32(owner + 1)),
+        m_end(owner < 0 ? m_program->header->nodeCount
+                        : quint32(owner) + quint32(m_program->nodes[owner].subtreeSize)),
+        m_remaining(count) {
+
+  }
+
+  int remaining() const override { return m_remaining; }
+
+  int remainingNodes() const override { return m_remaining > 0 ? int(m_end - m_next) : 0; }
+
+  std::vector<std::unique_ptr<CommandNode>> take(int max) override {
+    std::vector<std::unique_ptr<CommandNode>> out;
+    MappedProgram& p = *m_program;
+    out.reserve(std::min(max, m_remaining));
+
+    while (max-- > 0 && m_remaining > 0) {
+      const NodeRecord& rec = p.nodes[m_next];
+      CommandPtr cmd = CommandRegistry::create(p.typeName(rec.typeName));
+      if (!cmd) cmd = makePooled<BaseCommand>(); // unknown type keeps its place
+      for (int i = 0; i < rec.paramCount && i < cmd->paramCount(); ++i) {
+        cmd->setParam(i, p.params[rec.firstParam + i]);
+      }
+      if (rec.name != kNoName) cmd->setCommandName(p.string(quint32(rec.name)));
+
+      auto node = std::make_unique<CommandNode>(std::move(cmd));
+      if (rec.childCount > 0) {
+        node->setChildSource(std::make_unique<MappedChildSource>(m_program, qint32(m_next),
+                                                                 rec.childCount));
+      }
+      out.push_back(std::move(node));
+
+      m_next += quint32(rec.subtreeSize);
+      --m_remaining;
+    }
+    if (m_remaining == 0) m_program.reset();
+    return out;
+  }
+
+  // Records are decoded into one scratch command per type name instead of
+  // nodes.
+  bool visit(int skip, const Visitor& fn) const override {
+    if (skip >= remainingNodes()) return true;
+    MappedProgram& p = *m_program;
+    const quint32 first = m_next + quint32(skip);
+
+    // ends of the open ancestors of `first` below the owner, outermost first
+    std::vector<quint32> open;
+    for (qint32 a = p.nodes[first].parent, below = qint32(first); a > m_owner && a < below;
+         below = a, a = p.nodes[a].parent) {
+      open.push_back(quint32(a) + quint32(p.nodes[a].subtreeSize));
+    }
+    std::reverse(open.begin(), open.end());
+
+    QHash<quint32, CommandPtr> scratch;
+    for (quint32 i = first; i < m_end; ++i) {
+      while (!open.empty() && open.back() <= i) open.pop_back();
+      const NodeRecord& rec = p.nodes[i];
+      CommandPtr& cmd = scratch[rec.typeName];
+      if (!cmd) cmd = CommandRegistry::create(p.typeName(rec.typeName));
+      if (!cmd) cmd = makePooled<BaseCommand>();
+      for (int k = 0; k < rec.paramCount && k < cmd->paramCount(); ++k) {
+        cmd->setParam(k, p.params[rec.firstParam + k]);
+      }
+      cmd->setCommandName(rec.name != kNoName ? p.string(quint32(rec.name)) : QString());
+      if (!fn({cmd.get(), int(open.size()), rec.childCount > 0})) return false;
+      open.push_back(i + quint32(rec.subtreeSize));
+    }
+    return true;
+  }
+
+private:
+  std::shared_ptr<MappedProgram> m_program;
+  qint32 m_owner;
+  quint32 m_next;
+  quint32 m_end;
+  int m_remaining;
+};
+
+// One pass over the record table: every record lies inside its parent's
+// subtree, `parent` names the enclosing record, child counts and the
+// top-level count match, and parameter and string indices are in range.
+bool validRecords(const MappedProgram& p) {
+  const FileHeader& h = *p.header;
+  for (quint32 i = 0; i < h.stringCount; ++i) {
+    if (p.stringOffsets[i] > p.stringOffsets[i + 1]) return false;
+  }
+  if (p.stringOffsets[h.stringCount] > h.stringDataSize) return false;
+
+  struct Open { qint32 record; quint32 end; qint32 children; };
+  std::vector<Open> open;
+  quint32 topLevel = 0;
+  auto close = [&](const Open& o) { return p.nodes[o.record].childCount == o.children; };
+  for (quint32 i = 0; i < h.nodeCount; ++i) {
+    while (!open.empty() && open.back().end <= i) {
+      if (!close(open.back())) return false;
+      open.pop_back();
+    }
+    const NodeRecord& rec = p.nodes[i];
+    const quint32 limit = open.empty() ? h.nodeCount : open.back().end;
+    if (rec.subtreeSize < 1 || quint64(i) + quint64(rec.subtreeSize) > limit) return false;
+    if (rec.parent != (open.empty() ? -1 : open.back().record)) return false;
+    if (quint64(rec.firstParam) + rec.paramCount > h.paramCount) return false;
+    if (rec.typeName >= h.stringCount) return false;
+    if (rec.name != kNoName && (rec.name < 0 || quint32(rec.name) >= h.stringCount)) return false;
+
+    if (open.empty()) ++topLevel;
+    else ++open.back().children;
+    open.push_back({qint32(i), i + quint32(rec.subtreeSize), 0});
+  }
+  for (const Open& o : open) {
+    if (!close(o)) return false;
+  }
+  return topLevel == h.topLevelCount;
+}
+
+}
+
+bool ProgramFile::save(CommandModel* model, const QString& path, QString* error) {
+  if (!model) return false;
+  model->fetchAll(QModelIndex(), /*recursive=*/true);
+  const FlatCommandTree& flat = model->flatTree();
+
+  // slot 0 is Start, always recreated by the model
+  const int first = (flat.size() > 0 && model->isStartNode(flat.node(0))) ? 1 : 0;
+  const int count = flat.size() - first;
+
+  std::vector<NodeRecord> records(count);
+  std::vector<double> params;
+  std::vector<quint32> stringOffsets{0};
+  std::vector<char16_t> stringData;
+  QHash<QString, quint32> interned;
+
+  auto intern = [&](const QString& s) -> quint32 {
+    auto it = interned.constFind(s);
+    if (it != interned.constEnd()) return it.value();
+    const quint32 id = quint32(stringOffsets.size() - 1);
+    const char16_t* utf16 = reinterpret_cast<const char16_t*>(s.utf16());
+    stringData.insert(stringData.end(), utf16, utf16 + s.size());
+    stringOffsets.push_back(quint32(stringData.size()));
+    interned.insert(s, id);
+    return id;
+  };
+
+  quint32 topLevel = 0;
+  for (int i = 0; i < count; ++i) {
+    const int slot = first + i;
+    const Command* c = flat.command(slot);
+    NodeRecord& r = records[i];
+    std::memset(&r, 0, sizeof(r));
+    r.parent = flat.parent(slot) < first ? -1 : flat.parent(slot) - first;
+    r.subtreeSize = flat.subtreeSize(slot);
+    r.type = quint8(flat.type(slot));
+    r.name = kNoName;
+    if (r.parent >= 0) ++records[r.parent].childCount;
+    else ++topLevel;
+    if (!c) continue;
+
+    r.typeName = intern(c->typeName());
+    if (c->hasCustomName()) r.name = qint32(intern(c->commandName()));
+    r.firstParam = quint32(params.size());
+    r.paramCount = quint16(c->paramCount());
+    for (int p = 0; p < c->paramCount(); ++p) params.push_back(c->param(p));
+  }
+
+  FileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.byteOrder = kByteOrderMark;
+  h.nodeCount = quint32(count);
+  h.paramCount = quint32(params.size());
+  h.stringCount = quint32(stringOffsets.size() - 1);
+  h.topLevelCount = topLevel;
+  h.paramsOffset = sizeof(FileHeader) + records.size() * sizeof(NodeRecord);
+  h.stringOffsetsOffset = h.paramsOffset + params.size() * sizeof(double);
+  h.stringDataOffset = h.stringOffsetsOffset + stringOffsets.size() * sizeof(quint32);
+  h.stringDataSize = stringData.size();
+
+  QByteArray out;
+  out.reserve(qsizetype(h.stringDataOffset + stringData.size() * sizeof(char16_t)));
+  appendRaw(out, &h, 1);
+  appendRaw(out, records.data(), records.size());
+  appendRaw(out, params.data(), params.size());
+  appendRaw(out, stringOffsets.data(), stringOffsets.size());
+  appendRaw(out, stringData.data(), stringData.size());
+
+  QSaveFile f(path);
+  if (!f.open(QIODevice::WriteOnly) || f.write(out) != out.size() || !f.commit()) {
+    setError(error, f.errorString());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<ChildSource> ProgramFile::load(const QString& path, QString* error) {
+  auto program = std::make_shared<MappedProgram>();
+  program->file.setFileName(path);
+  if (!program->file.open(QIODevice::ReadOnly)) {
+    setError(error, program->file.errorString());
+    return nullptr;
+  }
+  const quint64 size = quint64(program->file.size());
+  if (size < sizeof(FileHeader)) {
+    setError(error, QStringLiteral("Not a program file"));
+    return nullptr;
+  }
+  const uchar* base = program->file.map(0, qint64(size));
+  if (!base) {
+    setError(error, program->file.errorString());
+    return nullptr;
+  }
+
+  const auto* h = reinterpret_cast<const FileHeader*>(base);
+  if (std::memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 || h->byteOrder != kByteOrderMark) {
+    setError(error, QStringLiteral("Not a program file"));
+    return nullptr;
+  }
+  if (h->version != kVersion) {
+    setError(error, QStringLiteral("Unsupported program file version %1").arg(h->version));
+    return nullptr;
+  }
+
+  const bool ok = h->paramsOffset == sizeof(FileHeader) + quint64(h->nodeCount) * sizeof(NodeRecord)
+      && h->stringOffsetsOffset == h->paramsOffset + quint64(h->paramCount) * sizeof(double)
+      && h->stringDataOffset == h->stringOffsetsOffset + (quint64(h->stringCount) + 1) * sizeof(quint32)
+      && h->stringDataOffset + h->stringDataSize * sizeof(char16_t) <= size;
+  if (!ok) {
+    setError(error, QStringLiteral("Truncated or corrupt program file"));
+    return nullptr;
+  }
+
+  program->header = h;
+  program->nodes = reinterpret_cast<const NodeRecord*>(base + sizeof(FileHeader));
+  program->params = reinterpret_cast<const double*>(base + h->paramsOffset);
+  program->stringOffsets = reinterpret_cast<const quint32*>(base + h->stringOffsetsOffset);
+  program->stringData = reinterpret_cast<const char16_t*>(base + h->stringDataOffset);
+  if (!validRecords(*program)) {
+    setError(error, QStringLiteral("Corrupt program file: invalid node records"));
+    return nullptr;
+  }
+  return std::make_unique<MappedChildSource>(std::move(program), -1, int(h->topLevelCount));
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef PROGRAMFILE_H
+#define PROGRAMFILE_H
+
+#include <QString>
+#include <memory>
+#include "childsource.h"
+
+namespace rp {
+
+class CommandModel;
+
+/**
+ * Program file
+ * Versioned binary format, read through a memory mapping without a parse
+ * step. Layout (native byte order, checked on load):
+ *   header | node records | parameters (double) | string offsets | UTF-16 text
+ * Node records are the program in pre-order (Start excluded), each with its
+ * parent, subtree size, child count, interned type/name strings and a slice
+ * of the parameter array. Commands are re-created by type name through
+ * CommandRegistry.
+ *
+ * load() checks the header and the whole record table (tree shape, child
+ * counts, parameter and string ranges) in one pass, so a corrupt file fails
+ * there instead of halfway through a fetch. It returns a ChildSource over
+ * the mapped records: nodes, commands and strings are built when the model
+ * fetches the rows (see CommandModel::fetchMore). The mapping lives as long
+ * as some part of the program is still pending.
+*/
+class ProgramFile {
+public:
+  // Files of any other version are rejected.
+  static constexpr quint32 kVersion = 2;
+
+  // Saves the whole program; pending rows are materialized first.
+  static bool save(CommandModel* model, const QString& path, QString* error = nullptr);
+
+  // Top-level rows of the program, for CommandModel::resetProgram().
+  static std::unique_ptr<ChildSource> load(const QString& path, QString* error = nullptr);
+};
+
+}
+
+#endif // PROGRAMFILE_H
@@ -0,0 +1,77 @@
+#include "programloader.h"
+#include "commandmodel.h"
+#include "programfile.h"
+#include "programtext.h"
+#include <QFile>
+#include <QThread>
+
+namespace rp {
+
+ProgramLoader::ProgramLoader(CommandModel* model, QObject* parent)
+    : QObject(parent), m_model(model) {
+
+}
+
+ProgramLoader::~ProgramLoader() {
+  if (m_thread) {
+    cancel();
+    m_thread->wait();
+    delete m_thread;
+  }
+}
+
+bool ProgramLoader::start(const QString& path) {
+  if (m_thread || !m_model) {
+    return false;
+  }
+  m_cancel.store(false);
+
+  if (!path.endsWith(QStringLiteral(".jsonl"), Qt::CaseInsensitive)) {
+    // binary: mapping the file is all the work there is
+    QString error;
+    auto program = ProgramFile::load(path, &error);
+    const bool ok = (program != nullptr);
+    if (ok) m_model->resetProgram(std::move(program));
+    QMetaObject::invokeMethod(this, [this, ok, error]{ emit finished(ok, error); },
+                              Qt::QueuedConnection);
+    return true;
+  }
+
+  struct Result {
+    std::unique_ptr<ChildSource> program; // null on error
+    QString error;
+  };
+  auto result = std::make_shared<Result>();
+
+  m_thread = QThread::create([this, path, result]{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      result->error = f.errorString();
+      return;
+    }
+    const qint64 total = f.size();
+    result->program = ProgramText::parse(&f, &result->error,
+                                         [this, total](qint64 done){ emit progress(done, total); },
+                                         &m_cancel);
+  });
+
+  // back on the GUI thread: install in one reset
+  connect(m_thread, &QThread::finished, this, [this, result]{
+    m_thread->deleteLater();
+    m_thread = nullptr;
+    if (result->program && !m_cancel.load()) {
+      m_model->resetProgram(std::move(result->program));
+      emit finished(true, QString());
+    } else {
+      emit finished(false, m_cancel.load() ? QStringLiteral("Cancelled") : result->error);
+    }
+  });
+  m_thread->start();
+  return true;
+}
+
+void ProgramLoader::cancel() {
+  m_cancel.store(true);
+}
+
+}
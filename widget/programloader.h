@@ -0,0 +1,45 @@
+#ifndef PROGRAMLOADER_H
+#define PROGRAMLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+
+class QThread;
+
+namespace rp {
+
+class CommandModel;
+
+/**
+ * Program loader
+ * Opens a program without blocking the GUI. Text programs are staged on a
+ * worker thread (see ProgramText::parse); the staged program replaces the
+ * model content with a single reset, so the view only builds the rows it
+ * shows. Binary programs are memory mapped (see ProgramFile) and need no
+ * worker.
+*/
+class ProgramLoader : public QObject {
+  Q_OBJECT
+public:
+  explicit ProgramLoader(CommandModel* model, QObject* parent = nullptr);
+  ~ProgramLoader() override;
+
+  // false while another load is running
+  bool start(const QString& path);
+  void cancel();
+  bool isRunning() const { return m_thread != nullptr; }
+
+signals:
+  void progress(qint64 bytesRead, qint64 bytesTotal);
+  void finished(bool ok, const QString& error);
+
+private:
+  CommandModel* m_model;
+  QThread* m_thread {nullptr};
+  std::atomic<bool> m_cancel {false};
+};
+
+}
+
+#endif // PROGRAMLOADER_H
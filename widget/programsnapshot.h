@@ -0,0 +1,62 @@
+#ifndef PROGRAMSNAPSHOT_H
+#define PROGRAMSNAPSHOT_H
+
+#include <QtGlobal>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "command.h"
+
+namespace rp {
+
+/**
+ * Program snapshot
+ * Immutable, self-contained copy of the program that worker threads can read
+ * while the user keeps editing. Topology arrays are shared between snapshots
+ * of the same structure revision and every command is a frozen clone that is
+ * shared until that command changes, so taking a snapshot costs one pointer
+ * copy per row plus one clone per edited command. Dropping the last
+ * reference frees it on whichever thread that happens, without touching the
+ * model.
+*/
+class ProgramSnapshot {
+public:
+  struct Topology {
+    std::vector<int32_t> parent;       // pre-order slot of the parent, -1 at top level
+    std::vector<int32_t> subtreeSize;  // slot + subtreeSize = end of the subtree
+    std::vector<uint16_t> depth;
+  };
+
+  ProgramSnapshot(quint64 structureRevision, quint64 dataRevision,
+                  std::shared_ptr<const Topology> topology,
+                  std::vector<std::shared_ptr<const Command>> commands)
+      : m_structureRevision(structureRevision)
+      , m_dataRevision(dataRevision)
+      , m_topology(std::move(topology))
+      , m_commands(std::move(commands)) {
+
+  }
+
+  quint64 structureRevision() const { return m_structureRevision; }
+  quint64 dataRevision() const { return m_dataRevision; }
+
+  int size() const { return static_cast<int>(m_commands.size()); }
+  int32_t parent(int slot) const { return m_topology->parent[slot]; }
+  int32_t subtreeSize(int slot) const { return m_topology->subtreeSize[slot]; }
+  uint16_t depth(int slot) const { return m_topology->depth[slot]; }
+  const Command* command(int slot) const { return m_commands[slot].get(); }
+
+  const std::shared_ptr<const Topology>& topology() const { return m_topology; }
+
+private:
+  const quint64 m_structureRevision;
+  const quint64 m_dataRevision;
+  const std::shared_ptr<const Topology> m_topology;
+  const std::vector<std::shared_ptr<const Command>> m_commands;
+};
+
+using ProgramSnapshotPtr = std::shared_ptr<const ProgramSnapshot>;
+
+}
+
+#endif // PROGRAMSNAPSHOT_H
@@ -0,0 +1,204 @@
+#include "programtext.h"
+#include "commandmodel.h"
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace rp {
+
+namespace {
+
+constexpr qsizetype kWriteChunk = 64 * 1024;
+constexpr int kParseBatch = 1024; // lines parsed before they are staged
+constexpr qint64 kProgressStep = 1024 * 1024;
+
+const QString kFormat = QStringLiteral("rprg-text");
+
+void setError(QString* error, const QString& msg) {
+  if (error) *error = msg;
+}
+
+CommandPtr commandFromLine(const QJsonObject& obj) {
+  CommandPtr cmd = CommandRegistry::create(obj.value(QStringLiteral("type")).toString());
+  if (!cmd) cmd = makePooled<BaseCommand>(); // unknown type keeps its place
+  const QJsonValue name = obj.value(QStringLiteral("name"));
+  if (name.isString()) cmd->setCommandName(name.toString());
+  const QJsonObject params = obj.value(QStringLiteral("params")).toObject();
+  for (int i = 0; i < cmd->paramCount() && !params.isEmpty(); ++i) {
+    const QJsonValue v = params.value(cmd->paramName(i));
+    if (v.isDouble()) cmd->setParam(i, v.toDouble());
+  }
+  return cmd;
+}
+
+// Pull parser: one line per next(), header and depth jumps validated here so
+// both the model importer and the detached builder see a well-formed stream.
+class LineReader {
+public:
+  explicit LineReader(QIODevice* device, const std::atomic<bool>* cancel = nullptr)
+      : m_device(device), m_cancel(cancel) {
+
+  }
+
+  // Next command and its depth; false at the end of input or on error.
+  bool next(int& depth, CommandPtr& cmd) {
+    while (m_error.isEmpty() && !m_device->atEnd()) {
+      if (m_cancel && m_cancel->load(std::memory_order_relaxed)) {
+        m_error = QStringLiteral("Cancelled");
+        return false;
+      }
+      const QByteArray raw = m_device->readLine().trimmed();
+      ++m_lineNo;
+      if (raw.isEmpty()) continue;
+
+      QJsonParseError parseError;
+      const QJsonObject obj = QJsonDocument::fromJson(raw, &parseError).object();
+      if (parseError.error != QJsonParseError::NoError) {
+        m_error = QStringLiteral("Line %1: %2").arg(m_lineNo).arg(parseError.errorString());
+        return false;
+      }
+
+      if (!m_headerSeen) {
+        m_headerSeen = true;
+        if (obj.value(QStringLiteral("format")).toString() != kFormat
+            || obj.value(QStringLiteral("version")).toInt() != ProgramText::kVersion) {
+          m_error = QStringLiteral("Not a program text file (version %1)").arg(ProgramText::kVersion);
+          return false;
+        }
+        continue;
+      }
+
+      depth = obj.value(QStringLiteral("depth")).toInt(-1);
+      if (depth < 0 || depth > m_depth + 1
+          || (depth == m_depth + 1 && (!m_previous || !m_previous->isAllowChild()))) {
+        m_error = QStringLiteral("Line %1: unexpected depth %2").arg(m_lineNo).arg(depth);
+        return false;
+      }
+      cmd = commandFromLine(obj);
+      m_depth = depth;
+      m_previous = cmd.get();
+      return true;
+    }
+    return false;
+  }
+
+  bool succeeded(QString* error) const {
+    if (m_error.isEmpty() && !m_headerSeen) {
+      setError(error, QStringLiteral("Empty program text file"));
+      return false;
+    }
+    setError(error, m_error);
+    return m_error.isEmpty();
+  }
+
+private:
+  QIODevice* m_device;
+  const std::atomic<bool>* m_cancel;
+  QString m_error;
+  qint64 m_lineNo {0};
+  bool m_headerSeen {false};
+  int m_depth {0};
+  Command* m_previous {nullptr};
+};
+
+}
+
+bool ProgramText::write(CommandModel* model, QIODevice* device, QString* error) {
+  if (!model || !device) return false;
+  model->fetchAll(QModelIndex(), /*recursive=*/true);
+  const FlatCommandTree& flat = model->flatTree();
+
+  QByteArray buf;
+  buf.reserve(kWriteChunk + 1024);
+  auto flush = [&]() {
+    if (device->write(buf) != buf.size()) {
+      setError(error, device->errorString());
+      return false;
+    }
+    buf.clear();
+    return true;
+  };
+
+  QJsonObject header;
+  header.insert(QStringLiteral("format"), kFormat);
+  header.insert(QStringLiteral("version"), kVersion);
+  buf += QJsonDocument(header).toJson(QJsonDocument::Compact);
+  buf += '\n';
+
+  for (int slot = 0; slot < flat.size(); ++slot) {
+    const Command* c = flat.command(slot);
+    if (!c || model->isStartNode(flat.node(slot))) continue; // Start is implicit
+
+    QJsonObject line;
+    line.insert(QStringLiteral("depth"), int(flat.depth(slot)));
+    line.insert(QStringLiteral("type"), c->typeName());
+    if (c->hasCustomName()) line.insert(QStringLiteral("name"), c->commandName());
+    if (c->paramCount() > 0) {
+      QJsonObject params;
+      for (int i = 0; i < c->paramCount(); ++i) params.insert(c->paramName(i), c->param(i));
+      line.insert(QStringLiteral("params"), params);
+    }
+    buf += QJsonDocument(line).toJson(QJsonDocument::Compact);
+    buf += '\n';
+
+    if (buf.size() >= kWriteChunk && !flush()) return false;
+  }
+  return flush();
+}
+
+bool ProgramText::read(CommandModel* model, QIODevice* device, QString* error) {
+  if (!model || !device) return false;
+
+  // the whole file is staged before the old program goes: an error on the
+  // last line must not leave half a program behind
+  std::unique_ptr<ChildSource> program = parse(device, error);
+  if (!program) return false;
+  model->resetProgram(std::move(program));
+  return true;
+}
+
+std::unique_ptr<ChildSource> ProgramText::parse(QIODevice* device, QString* error,
+                                                const std::function<void(qint64)>& progress,
+                                                const std::atomic<bool>* cancel) {
+  if (!device) return nullptr;
+
+  auto topLevel = std::make_unique<CommandListSource>();
+  std::vector<CommandListSource*> open{topLevel.get()}; // open.size() == current depth + 1
+  qint64 reported = 0;
+
+  struct Line { int depth; CommandPtr command; };
+  std::vector<Line> batch;
+  batch.reserve(kParseBatch);
+  auto stage = [&]() {
+    for (Line& line : batch) {
+      if (line.depth + 1 > int(open.size())) {
+        auto children = std::make_unique<CommandListSource>();
+        CommandListSource* block = children.get();
+        open.back()->setLastChildren(std::move(children));
+        open.push_back(block);
+      } else {
+        open.resize(line.depth + 1);
+      }
+      open.back()->append(std::move(line.command));
+    }
+    batch.clear();
+  };
+
+  LineReader reader(device, cancel);
+  Line line;
+  while (reader.next(line.depth, line.command)) {
+    batch.push_back(std::move(line));
+    if (int(batch.size()) < kParseBatch) continue;
+    stage();
+    if (progress && device->pos() - reported >= kProgressStep) {
+      reported = device->pos();
+      progress(reported);
+    }
+  }
+  stage();
+  if (progress) progress(device->pos());
+  if (!reader.succeeded(error)) return nullptr;
+  return topLevel;
+}
+
+}
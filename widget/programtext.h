@@ -0,0 +1,49 @@
+#ifndef PROGRAMTEXT_H
+#define PROGRAMTEXT_H
+
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "childsource.h"
+
+class QIODevice;
+
+namespace rp {
+
+class CommandModel;
+
+/**
+ * Program text format
+ * JSON Lines, meant for version control: a header line, then one command per
+ * line in depth-first order with its depth, type, optional custom name and
+ * named parameters, e.g.
+ *   {"format":"rprg-text","version":1}
+ *   {"depth":0,"type":"If"}
+ *   {"depth":1,"params":{"speed":100,"x":10,"y":0,"z":5},"type":"MoveL"}
+ * Both directions stream: the writer formats one line at a time, the reader
+ * pulls lines in fixed-size batches into a staging CommandListSource, so no
+ * document of the whole file and no node is ever built. The staged program
+ * replaces the model content with a single reset once the whole file has
+ * parsed; nodes are created as the view fetches rows.
+*/
+class ProgramText {
+public:
+  static constexpr int kVersion = 1;
+
+  static bool write(CommandModel* model, QIODevice* device, QString* error = nullptr);
+  // Replaces the program in `model`; not undoable. On error the model is
+  // left as it was.
+  static bool read(CommandModel* model, QIODevice* device, QString* error = nullptr);
+
+  // Top-level rows of the program for CommandModel::resetProgram(), or
+  // nullptr on error. Touches no model, so it can run on a worker thread.
+  // `progress` gets the bytes read so far, `cancel` is polled once per line.
+  static std::unique_ptr<ChildSource> parse(QIODevice* device, QString* error = nullptr,
+                                            const std::function<void(qint64)>& progress = {},
+                                            const std::atomic<bool>* cancel = nullptr);
+};
+
+}
+
+#endif // PROGRAMTEXT_H
@@ -0,0 +1,403 @@
+#include "programvalidator.h"
+#include "commandmodel.h"
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace rp {
+
+static NameTable::Id customName(const Command* c) {
+  return c && c->hasCustomName() ? c->nameId() : NameTable::kNone;
+}
+
+ProgramValidator::ProgramValidator(CommandModel* model, QObject* parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_flush(new QTimer(this)) {
+  // everything dirtied during one event loop pass goes out as one job
+  m_flush->setSingleShot(true);
+  m_flush->setInterval(0);
+  connect(m_flush, &QTimer::timeout, this, &ProgramValidator::flush);
+
+  connect(model, &QAbstractItemModel::dataChanged, this,
+          [this](const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                 const QList<int>& roles) {
+            if (CommandModel::isDiagnosticsOnly(roles)) return;
+            for (int r = topLeft.row(); r <= bottomRight.row(); ++r) {
+              markDirty(m_model->nodeFromIndex(m_model->index(r, 0, topLeft.parent())));
+            }
+          });
+  connect(model, &QAbstractItemModel::rowsInserted, this,
+          [this](const QModelIndex& parent, int first, int last) {
+            for (int r = first; r <= last; ++r) {
+              markSubtree(m_model->nodeFromIndex(m_model->index(r, 0, parent)));
+            }
+            CommandNode* p = parent.isValid() ? m_model->nodeFromIndex(parent) : m_model->rootNode();
+            fetched(p);
+            markDirty(p); // may no longer be empty
+          });
+  connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+          [this](const QModelIndex& parent, int first, int last) {
+            for (int r = first; r <= last; ++r) {
+              forgetSubtree(m_model->nodeFromIndex(m_model->index(r, 0, parent)));
+            }
+          });
+  connect(model, &QAbstractItemModel::rowsRemoved, this,
+          [this](const QModelIndex& parent) { markDirty(m_model->nodeFromIndex(parent)); });
+  connect(model, &QAbstractItemModel::rowsMoved, this,
+          [this](const QModelIndex& srcParent, int, int, const QModelIndex& dstParent) {
+            markDirty(m_model->nodeFromIndex(srcParent));
+            markDirty(m_model->nodeFromIndex(dstParent));
+          });
+  connect(model, &QAbstractItemModel::modelReset, this, &ProgramValidator::markAll);
+
+  m_thread = QThread::create([this]{ work(); });
+  m_thread->start();
+  markAll();
+}
+
+ProgramValidator::~ProgramValidator() {
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  m_thread->wait();
+  delete m_thread;
+}
+
+void ProgramValidator::setLimits(const Limits& limits) {
+  m_limits = limits;
+  m_limitsChanged = true;
+  m_flush->start();
+}
+
+void ProgramValidator::markDirty(CommandNode* node) {
+  if (!node || !node->command()) return; // invisible root
+  m_dirty.insert(node);
+  if (!m_flush->isActive()) m_flush->start();
+}
+
+void ProgramValidator::markSubtree(CommandNode* node) {
+  std::vector<CommandNode*> stack;
+  if (node) stack.push_back(node);
+  while (!stack.empty()) {
+    CommandNode* n = stack.back();
+    stack.pop_back();
+    markDirty(n);
+    if (n->hasPendingChildren()) track(n);
+    for (int i = 0; i < n->childCount(); ++i) stack.push_back(n->child(i));
+  }
+}
+
+// Called before rows leave the tree: their addresses may be reused by new
+// nodes, so results still in flight for them must not be applied.
+void ProgramValidator::forgetSubtree(CommandNode* node) {
+  std::vector<CommandNode*> stack;
+  if (node) stack.push_back(node);
+  while (!stack.empty()) {
+    CommandNode* n = stack.back();
+    stack.pop_back();
+    m_dirty.remove(n);
+    m_findings.remove(n);
+    if (m_stamps.remove(n)) m_removed.push_back(n); // the worker knows it
+    if (m_owners.remove(n)) m_dropped.emplace_back(n, std::numeric_limits<int>::max());
+    for (int i = 0; i < n->childCount(); ++i) stack.push_back(n->child(i));
+  }
+  if ((!m_removed.empty() || !m_dropped.empty()) && !m_flush->isActive()) m_flush->start();
+}
+
+void ProgramValidator::markAll() {
+  m_reset = true;
+  m_dirty.clear();
+  m_removed.clear();
+  m_dropped.clear();
+  m_stamps.clear();
+  m_findings.clear();
+  m_owners.clear();
+  m_scanQueue.clear();
+  CommandNode* root = m_model->rootNode();
+  if (root->hasPendingChildren()) track(root);
+  for (int r = 0; r < root->childCount(); ++r) markSubtree(root->child(r));
+  m_flush->start();
+}
+
+// Starts reading the pending rows of `owner` (the invisible root for
+// top-level ones).
+void ProgramValidator::track(CommandNode* owner) {
+  if (m_owners.contains(owner)) return;
+  const quint64 stamp = ++m_nextStamp;
+  m_owners.insert(owner, Owner{stamp, owner->pendingNodeCount(), 0, {}});
+  m_scanQueue.emplace_back(owner, stamp);
+  if (!m_flush->isActive()) m_flush->start();
+}
+
+// Rows of `owner` became nodes: they are checked as rows from now on (see
+// markSubtree), so the worker drops them as pending rows.
+void ProgramValidator::fetched(CommandNode* owner) {
+  auto it = m_owners.find(owner);
+  if (it == m_owners.end()) return;
+  if (!owner->hasPendingChildren()) {
+    m_owners.erase(it);
+    m_dropped.emplace_back(owner, std::numeric_limits<int>::max());
+  } else {
+    const int consumed = it->base - owner->pendingNodeCount();
+    it->scanned = std::max(it->scanned, consumed);
+    it->findings.erase(it->findings.begin(), it->findings.lower_bound(consumed));
+    m_dropped.emplace_back(owner, consumed);
+  }
+  publish(owner);
+}
+
+// Reads up to `budget` pending rows, owner by owner, straight from the
+// sources.
+void ProgramValidator::scanPending(std::vector<Item>& items, int budget) {
+  while (budget > 0 && !m_scanQueue.empty()) {
+    const auto [owner, stamp] = m_scanQueue.front();
+    auto it = m_owners.find(owner);
+    if (it == m_owners.end() || it->stamp != stamp || !owner->childSource()) {
+      m_scanQueue.pop_front(); // forgotten or fetched meanwhile
+      continue;
+    }
+    const int consumed = it->base - owner->pendingNodeCount();
+    int ordinal = std::max(it->scanned, consumed);
+    const bool more = !owner->childSource()->visit(ordinal - consumed,
+                                                   [&](const ChildSource::PendingRow& row) {
+      const bool emptyBlock = row.command && row.command->type() == Command::Type::If
+                              && !row.hasChildren;
+      items.push_back(itemOf(row.command, {owner, ordinal++}, stamp, emptyBlock));
+      return --budget > 0;
+    });
+    it->scanned = ordinal;
+    if (more) break;
+    m_scanQueue.pop_front();
+  }
+}
+
+ProgramValidator::Item ProgramValidator::itemOf(const Command* c, Key key, quint64 stamp,
+                                                bool emptyBlock) {
+  Item item;
+  item.key = key;
+  item.stamp = stamp;
+  item.emptyBlock = emptyBlock;
+  if (!c) return item;
+  item.type = c->type();
+  item.paramCount = c->paramCount();
+  for (int i = 0; i < std::min(item.paramCount, 4); ++i) item.params[i] = c->param(i);
+  item.name = customName(c);
+  return item;
+}
+
+void ProgramValidator::flush() {
+  Job job;
+  job.reset = std::exchange(m_reset, false);
+  job.limitsChanged = std::exchange(m_limitsChanged, false);
+  job.limits = m_limits;
+  job.removed.swap(m_removed);
+  job.dropped.swap(m_dropped);
+  job.items.reserve(m_dirty.size());
+  for (CommandNode* n : std::as_const(m_dirty)) {
+    const quint64 stamp = ++m_nextStamp;
+    const Command* c = n->command().get();
+    const bool emptyBlock = c && c->type() == Command::Type::If
+                            && n->childCount() == 0 && !n->hasPendingChildren();
+    job.items.push_back(itemOf(c, {n, -1}, stamp, emptyBlock));
+    m_stamps.insert(n, stamp);
+  }
+  m_dirty.clear();
+  scanPending(job.items, kScanSlice);
+
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_jobs.push_back(std::move(job));
+  }
+  m_wake.notify_one();
+
+  if (!m_scanQueue.empty()) m_flush->start(); // next slice on the next pass
+}
+
+void ProgramValidator::apply(const std::vector<Result>& results) {
+  QSet<CommandNode*> touched;
+  for (const Result& r : results) {
+    CommandNode* n = r.key.node;
+    if (r.key.ordinal < 0) {
+      auto it = m_stamps.constFind(n);
+      if (it == m_stamps.constEnd() || it.value() != r.stamp) continue; // outdated
+      if (r.messages.isEmpty()) m_findings.remove(n);
+      else m_findings.insert(n, Findings{r.severity, r.messages});
+    } else {
+      auto it = m_owners.find(n);
+      if (it == m_owners.end() || it->stamp != r.stamp
+          || r.key.ordinal < it->base - n->pendingNodeCount()) {
+        continue; // forgotten, or fetched since
+      }
+      if (r.severity == CommandModel::NoIssue) it->findings.erase(r.key.ordinal);
+      else it->findings[r.key.ordinal] = r.severity;
+    }
+    touched.insert(n);
+  }
+  for (CommandNode* n : std::as_const(touched)) publish(n);
+}
+
+// The row's own findings plus a summary of its pending rows. Findings of
+// pending top-level rows have no row to show on until they are fetched.
+void ProgramValidator::publish(CommandNode* node) {
+  auto own = m_findings.constFind(node);
+  int severity = own != m_findings.constEnd() ? own->severity : int(CommandModel::NoIssue);
+  QStringList messages = own != m_findings.constEnd() ? own->messages : QStringList();
+  auto owner = m_owners.constFind(node);
+  if (owner != m_owners.constEnd() && !owner->findings.empty()) {
+    for (const auto& f : owner->findings) severity = std::max(severity, f.second);
+    messages << QString("%1 row(s) with issues not loaded yet").arg(int(owner->findings.size()));
+  }
+  if (node != m_model->rootNode()) m_model->setDiagnostics(node, severity, messages);
+}
+
+// Worker thread. Owns m_items/m_byName; talks to the GUI through the job
+// queue and queued calls only.
+void ProgramValidator::work() {
+  for (;;) {
+    std::vector<Job> jobs;
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_wake.wait(lock, [this]{ return m_quit || !m_jobs.empty(); });
+      if (m_quit) return;
+      jobs.swap(m_jobs);
+    }
+
+    std::vector<Result> results;
+    for (Job& job : jobs) {
+      std::vector<Result> r = process(job);
+      results.insert(results.end(), std::make_move_iterator(r.begin()),
+                     std::make_move_iterator(r.end()));
+    }
+    if (results.empty()) continue;
+    QMetaObject::invokeMethod(this, [this, results = std::move(results)]{
+      apply(results);
+    }, Qt::QueuedConnection);
+  }
+}
+
+std::vector<ProgramValidator::Result> ProgramValidator::process(Job& job) {
+  if (job.reset) {
+    m_items.clear();
+    m_pending.clear();
+    m_byName.clear();
+  }
+
+  QSet<Key> affected;
+  if (job.limitsChanged) {
+    m_workerLimits = job.limits;
+    for (auto it = m_items.cbegin(); it != m_items.cend(); ++it) affected.insert(it->key);
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+      for (const auto& entry : it.value()) affected.insert(entry.second.key);
+    }
+  }
+
+  for (CommandNode* n : job.removed) {
+    auto it = m_items.find(n);
+    if (it == m_items.end()) continue;
+    rename(it->key, it->name, NameTable::kNone, affected);
+    affected.remove(it->key);
+    m_items.erase(it);
+  }
+
+  for (const auto& [owner, below] : job.dropped) {
+    auto it = m_pending.find(owner);
+    if (it == m_pending.end()) continue;
+    std::map<int, Item>& rows = it.value();
+    const auto end = rows.lower_bound(below);
+    for (auto row = rows.begin(); row != end; ++row) {
+      rename(row->second.key, row->second.name, NameTable::kNone, affected);
+      affected.remove(row->second.key);
+    }
+    rows.erase(rows.begin(), end);
+    if (rows.empty()) m_pending.erase(it);
+  }
+
+  for (Item& item : job.items) {
+    const Item* old = find(item.key);
+    rename(item.key, old ? old->name : NameTable::kNone, item.name, affected);
+    affected.insert(item.key);
+    if (item.key.ordinal < 0) m_items.insert(item.key.node, item);
+    else m_pending[item.key.node][item.key.ordinal] = item;
+  }
+
+  std::vector<Result> results;
+  results.reserve(affected.size());
+  for (const Key& k : std::as_const(affected)) {
+    if (const Item* item = find(k)) results.push_back(check(*item));
+  }
+  return results;
+}
+
+const ProgramValidator::Item* ProgramValidator::find(Key key) const {
+  if (key.ordinal < 0) {
+    auto it = m_items.constFind(key.node);
+    return it != m_items.constEnd() ? &it.value() : nullptr;
+  }
+  auto owner = m_pending.constFind(key.node);
+  if (owner == m_pending.constEnd()) return nullptr;
+  auto it = owner->find(key.ordinal);
+  return it != owner->end() ? &it->second : nullptr;
+}
+
+// Keeps m_byName current. Only rows whose duplicate status flips need a new
+// check: the last one left under the old name, the first one already under
+// the new name.
+void ProgramValidator::rename(Key key, NameTable::Id before, NameTable::Id after,
+                             QSet<Key>& affected) {
+  if (before == after) return;
+  if (before != NameTable::kNone) {
+    auto it = m_byName.find(before);
+    if (it != m_byName.end()) {
+      it->remove(key);
+      if (it->size() == 1) affected.insert(*it->cbegin());
+      if (it->isEmpty()) m_byName.erase(it);
+    }
+  }
+  if (after != NameTable::kNone) {
+    QSet<Key>& owners = m_byName[after];
+    if (owners.size() == 1) affected.insert(*owners.cbegin());
+    owners.insert(key);
+  }
+}
+
+ProgramValidator::Result ProgramValidator::check(const Item& item) const {
+  Result r {item.key, item.stamp, CommandModel::NoIssue, {}};
+  auto report = [&r](int severity, const QString& message) {
+    r.messages << message;
+    r.severity = std::max(r.severity, severity);
+  };
+
+  const Limits& lim = m_workerLimits;
+
+  if (item.type == Command::Type::MoveL && item.paramCount >= 4) {
+    const double x = item.params[0], y = item.params[1], z = item.params[2], v = item.params[3];
+    if (v <= 0) {
+      report(CommandModel::Error, QString("Speed must be greater than 0"));
+    } else if (v > lim.maxSpeed) {
+      report(CommandModel::Warning, QString("Speed %1 exceeds the limit of %2 mm/s")
+                                        .arg(v).arg(lim.maxSpeed));
+    }
+    if (x < lim.minX || x > lim.maxX || y < lim.minY || y > lim.maxY
+        || z < lim.minZ || z > lim.maxZ) {
+      report(CommandModel::Error, QString("Target (%1, %2, %3) is outside the workspace")
+                                      .arg(x).arg(y).arg(z));
+    }
+  }
+
+  if (item.emptyBlock) {
+    report(CommandModel::Warning, QString("Empty If block"));
+  }
+
+  if (item.name != NameTable::kNone && m_byName.value(item.name).size() > 1) {
+    report(CommandModel::Warning, QString("Name \"%1\" is used more than once")
+                                      .arg(NameTable::name(item.name)));
+  }
+  return r;
+}
+
+}
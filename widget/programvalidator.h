@@ -0,0 +1,159 @@
+#ifndef PROGRAMVALIDATOR_H
+#define PROGRAMVALIDATOR_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "command.h"
+#include "nametable.h"
+
+class QThread;
+class QTimer;
+
+namespace rp {
+
+class CommandModel;
+class CommandNode;
+
+/**
+ * Program validator
+ * Checks the program against a set of rules on a worker thread and stores
+ * the findings in the model (CommandModel::DiagnosticsRole). Only rows that
+ * a model change touched are sent to the worker, batched once per event loop
+ * pass, so an edit costs a check of that row (and of rows sharing its name)
+ * instead of a full pass. A reset or new limits re-check everything.
+ *
+ * Rules: MoveL speed must be positive and within the limit, MoveL targets
+ * must lie inside the workspace, If blocks must not be empty, custom command
+ * names must be unique. Rows still pending in a ChildSource are read from
+ * the source itself (ChildSource::visit), kScanSlice per event loop pass,
+ * without building nodes; their findings are summed up on the block that
+ * holds them until they are fetched and checked as rows. The worker only
+ * ever sees plain parameter values, never the commands.
+*/
+class ProgramValidator : public QObject {
+  Q_OBJECT
+public:
+  struct Limits {
+    double minX {-2000}, minY {-2000}, minZ {-2000}; // mm
+    double maxX {2000}, maxY {2000}, maxZ {2000};
+    double maxSpeed {2000};                          // mm/s
+  };
+
+  explicit ProgramValidator(CommandModel* model, QObject* parent = nullptr);
+  ~ProgramValidator() override;
+
+  void setLimits(const Limits& limits);
+  const Limits& limits() const { return m_limits; }
+
+private:
+  // A row (`ordinal` -1) or a row still pending under `node`, numbered in
+  // pre-order from the first row its source had. Node pointers are only keys
+  // on the worker side, it never dereferences them.
+  struct Key {
+    CommandNode* node;
+    int ordinal;
+    bool operator==(const Key& o) const { return node == o.node && ordinal == o.ordinal; }
+  };
+  friend size_t qHash(const Key& k, size_t seed) { return qHashMulti(seed, k.node, k.ordinal); }
+
+  // What the rules look at, copied on the GUI thread. `stamp` tells the GUI
+  // whether a result still matches the row (for pending rows: the owner).
+  struct Item {
+    Key key {nullptr, -1};
+    quint64 stamp {0};
+    Command::Type type {Command::Type::Base};
+    int paramCount {0};
+    double params[4] {};
+    NameTable::Id name {NameTable::kNone};
+    bool emptyBlock {false};
+  };
+
+  struct Job {
+    bool reset {false};
+    bool limitsChanged {false};
+    Limits limits;
+    std::vector<CommandNode*> removed;
+    std::vector<std::pair<CommandNode*, int>> dropped; // pending rows below an ordinal
+    std::vector<Item> items;
+  };
+
+  struct Result {
+    Key key;
+    quint64 stamp;
+    int severity;
+    QStringList messages;
+  };
+
+  // A node whose rows are still partly pending.
+  struct Owner {
+    quint64 stamp;
+    int base;                  // pendingNodeCount() when first seen
+    int scanned;               // ordinals below this were sent to the worker
+    std::map<int, int> findings; // ordinal -> severity, rows with issues only
+  };
+
+  // GUI side
+  void markDirty(CommandNode* node);
+  void markSubtree(CommandNode* node);
+  void forgetSubtree(CommandNode* node);
+  void markAll();
+  void track(CommandNode* owner);
+  void fetched(CommandNode* owner);
+  void scanPending(std::vector<Item>& items, int budget);
+  void flush();
+  void apply(const std::vector<Result>& results);
+  void publish(CommandNode* node);
+  static Item itemOf(const Command* c, Key key, quint64 stamp, bool emptyBlock);
+
+  // worker side
+  void work();
+  std::vector<Result> process(Job& job);
+  void rename(Key key, NameTable::Id before, NameTable::Id after, QSet<Key>& affected);
+  Result check(const Item& item) const;
+  const Item* find(Key key) const;
+
+  static constexpr int kScanSlice = 4096; // pending rows read per flush()
+
+  CommandModel* m_model;
+  QTimer* m_flush;
+  QThread* m_thread;
+  Limits m_limits;
+
+  QSet<CommandNode*> m_dirty;
+  std::vector<CommandNode*> m_removed;
+  std::vector<std::pair<CommandNode*, int>> m_dropped;
+  QHash<const CommandNode*, quint64> m_stamps; // live rows -> last submitted stamp
+  struct Findings {
+    int severity;
+    QStringList messages;
+  };
+  QHash<const CommandNode*, Findings> m_findings; // rows with issues only
+  QHash<CommandNode*, Owner> m_owners;
+  std::deque<std::pair<CommandNode*, quint64>> m_scanQueue; // owners with rows left to read
+  quint64 m_nextStamp {0};
+  bool m_reset {true};
+  bool m_limitsChanged {false};
+
+  // GUI -> worker queue, guarded by m_lock
+  std::mutex m_lock;
+  std::condition_variable m_wake;
+  std::vector<Job> m_jobs;
+  bool m_quit {false};
+
+  // worker state
+  QHash<CommandNode*, Item> m_items;
+  QHash<CommandNode*, std::map<int, Item>> m_pending; // by owner, then ordinal
+  QHash<NameTable::Id, QSet<Key>> m_byName;
+  Limits m_workerLimits;
+};
+
+}
+
+#endif // PROGRAMVALIDATOR_H
@@ -1,39 +1,290 @@
 #ifndef ROWDELEGATE_H
 #define ROWDELEGATE_H
 
+#include <QAbstractItemView>
+#include <QApplication>
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPersistentModelIndex>
+#include <QStaticText>
 #include <QStyledItemDelegate>
+#include <QToolTip>
+#include <algorithm>
 #include "commandrowwidget.h"
 
 namespace rp {
 
+/**
+ * Row delegate
+ * Paints a row exactly like CommandRowWidget ([Order] [Title] [Up Down Delete])
+ * and hit-tests clicks on the painted buttons in editorEvent(), so a row
+ * costs no QObject at all. When CommandTreeView runs with row widgets (see
+ * setRowWidgets()) only the background is painted underneath them.
+*/
 class RowDelegate : public QStyledItemDelegate {
   Q_OBJECT
 public:
   explicit RowDelegate(QObject* parent = nullptr) : QStyledItemDelegate(parent) {}
 
-  QWidget* createEditor(QWidget* parent, const QStyleOptionViewItem& option, const QModelIndex& index) const override {
-    Q_UNUSED(option);
-    auto* w = new CommandRowWidget(parent);
-    return w;
+  enum Button { NoButton = -1, UpButton = 0, DownButton, DeleteButton, ButtonCount };
+
+  // row highlighted as the command being executed
+  void setActiveIndex(const QModelIndex& idx) { m_active = idx; }
+  // false while row widgets cover the rows: only the background is painted
+  void setPaintContent(bool on) { m_paintContent = on; }
+
+  QSize sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const override {
+    // fixed row height 36 px
+    return QSize(0, kRowHeight);
   }
 
-  void setEditorData(QWidget* editor, const QModelIndex& index) const override {
-    auto* row = qobject_cast<CommandRowWidget*>(editor);
+  void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override {
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    const QWidget* view = opt.widget;
+    QStyle* style = view ? view->style() : QApplication::style();
     auto* m = const_cast<CommandModel*>(static_cast<const CommandModel*>(index.model()));
-    row->setContext(index, m);
+
+    // background: selection/hover from the style, execution highlight on top
+    opt.text.clear();
+    opt.icon = QIcon();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter, view);
+    if (m_active.isValid() && m_active == index) {
+      painter->fillRect(opt.rect, opt.palette.color(QPalette::Highlight).lighter(170));
+    }
+    if (!m_paintContent) {
+      return;
+    }
+
+    const Layout l = layout(opt.rect, index);
+    const RowText& text = rowText(m, index, opt, l.title.width());
+    const QPalette::ColorRole textRole = (opt.state & QStyle::State_Selected)
+                                             ? QPalette::HighlightedText : QPalette::WindowText;
+    painter->save();
+    painter->setPen(opt.palette.color(textRole));
+
+    painter->setFont(orderFont(opt.font));
+    painter->drawStaticText(centered(l.order, text.order), text.order);
+
+    if (!l.diag.isEmpty()) {
+      const int severity = index.data(CommandModel::DiagnosticSeverityRole).toInt();
+      style->standardIcon(CommandRowWidget::severityIcon(severity), nullptr, view)
+          .paint(painter, l.diag);
+    }
+
+    painter->setFont(opt.font);
+    painter->drawStaticText(centered(l.title, text.title), text.title);
+    painter->restore();
+
+    const CommandRowWidget::Actions a = CommandRowWidget::actions(m, index);
+    const bool enabled[ButtonCount] = {a.up, a.down, a.del};
+    static const QStyle::StandardPixmap icons[ButtonCount] = {
+      QStyle::SP_ArrowUp, QStyle::SP_ArrowDown, QStyle::SP_TrashIcon
+    };
+    for (int b = 0; b < ButtonCount; ++b) {
+      QStyleOptionButton btn;
+      btn.rect = l.buttons[b];
+      btn.palette = opt.palette;
+      btn.icon = style->standardIcon(icons[b], nullptr, view);
+      btn.iconSize = QSize(16, 16);
+      btn.state = enabled[b] ? QStyle::State_Enabled : QStyle::State_None;
+      btn.state |= (m_pressed == index && m_pressedButton == b) ? QStyle::State_Sunken
+                                                                : QStyle::State_Raised;
+      style->drawControl(QStyle::CE_PushButton, &btn, painter, view);
+    }
   }
 
-  void updateEditorGeometry(QWidget* editor,
-                            const QStyleOptionViewItem& option,
-                            const QModelIndex& index) const override {
-    Q_UNUSED(index);
-    editor->setGeometry(option.rect);
+  // Button rows are pressed and released like real buttons; a release on
+  // the title announces the command. Presses on a button do not change the
+  // selection.
+  bool editorEvent(QEvent* event, QAbstractItemModel* model,
+                   const QStyleOptionViewItem& option, const QModelIndex& index) override {
+    if (!m_paintContent) {
+      return QStyledItemDelegate::editorEvent(event, model, option, index);
+    }
+    auto* m = static_cast<CommandModel*>(model);
+    switch (event->type()) {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonDblClick: {
+      auto* me = static_cast<QMouseEvent*>(event);
+      if (me->button() != Qt::LeftButton) break;
+      const int b = buttonAt(option.rect, index, me->position().toPoint());
+      if (b == NoButton) break;
+      if (isEnabled(m, index, b)) {
+        m_pressed = index;
+        m_pressedButton = b;
+        repaint(option, index);
+      }
+      return true;
+    }
+    case QEvent::MouseButtonRelease: {
+      auto* me = static_cast<QMouseEvent*>(event);
+      if (me->button() != Qt::LeftButton) break;
+      const QPoint pos = me->position().toPoint();
+      const int b = buttonAt(option.rect, index, pos);
+      const bool clicked = m_pressed.isValid() && m_pressed == index
+                           && m_pressedButton == b;
+      if (m_pressed.isValid()) repaint(option, m_pressed);
+      m_pressed = QPersistentModelIndex();
+      m_pressedButton = NoButton;
+      if (clicked) {
+        // the handler may move or delete the row
+        const QPersistentModelIndex target = index;
+        emit rowAction(target, b == UpButton ? RowAction::MoveUp
+                               : b == DownButton ? RowAction::MoveDown
+                                                 : RowAction::Delete);
+        return true;
+      }
+      if (b != NoButton) return true;
+      if (layout(option.rect, index).title.contains(pos)) {
+        emit rowAction(index, RowAction::Click);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+    return QStyledItemDelegate::editorEvent(event, model, option, index);
   }
 
-  QSize sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const {
-    // fixed row height 36 px
-    return QSize(0, 36);
+  // tooltips of the painted parts, as the row widget sets them
+  bool helpEvent(QHelpEvent* event, QAbstractItemView* view,
+                 const QStyleOptionViewItem& option, const QModelIndex& index) override {
+    if (m_paintContent && event->type() == QEvent::ToolTip) {
+      QString tip;
+      if (layout(option.rect, index).diag.contains(event->pos())) {
+        tip = index.data(CommandModel::DiagnosticsRole).toStringList().join(QLatin1Char('\n'));
+      } else {
+        switch (buttonAt(option.rect, index, event->pos())) {
+        case UpButton: tip = QStringLiteral("Move up"); break;
+        case DownButton: tip = QStringLiteral("Move down"); break;
+        case DeleteButton: tip = QStringLiteral("Delete"); break;
+        default: break;
+        }
+      }
+      if (!tip.isEmpty()) {
+        QToolTip::showText(event->globalPos(), tip, view);
+        return true;
+      }
+    }
+    return QStyledItemDelegate::helpEvent(event, view, option, index);
+  }
+
+signals:
+  void rowAction(const QModelIndex& idx, rp::RowAction action);
+
+private:
+  static constexpr int kRowHeight = 36;
+  static constexpr int kMargin = 6;   // same as CommandRowWidget's layout
+  static constexpr int kSpacing = 6;
+  static constexpr int kOrderWidth = 24;
+  static constexpr int kButtonSize = 28;
+  static constexpr int kIconSize = 16;
+
+  // Laid-out text of a row, rebuilt only when the command's text stamp, the
+  // order number or the available width changes. Repaints of an unchanged
+  // row do no string formatting at all.
+  struct RowText {
+    quint64 stamp {0};
+    int width {-1};
+    QStaticText title;
+    int orderNumber {-1};
+    QStaticText order;
+  };
+  static constexpr int kMaxCachedRows = 4096; // a few screens' worth
+
+  const RowText& rowText(CommandModel* m, const QModelIndex& index,
+                         const QStyleOptionViewItem& opt, int width) const {
+    if (m_text.size() >= kMaxCachedRows || opt.font != m_textFont) {
+      m_text.clear(); // entries of rows long gone, or laid out for another font
+      m_textFont = opt.font;
+    }
+    auto* node = static_cast<CommandNode*>(index.internalPointer());
+    RowText& t = m_text[node];
+
+    const quint64 stamp = node->textStamp();
+    if (t.stamp != stamp || t.width != width) {
+      t.title.setText(opt.fontMetrics.elidedText(CommandRowWidget::titleText(m, index),
+                                                 Qt::ElideRight, width));
+      t.title.setTextFormat(Qt::PlainText);
+      t.title.prepare(QTransform(), opt.font);
+      t.stamp = stamp;
+      t.width = width;
+    }
+    const int order = CommandRowWidget::orderNumber(m, index);
+    if (t.orderNumber != order) {
+      t.order.setText(QString::number(order));
+      t.order.setTextFormat(Qt::PlainText);
+      t.order.prepare(QTransform(), orderFont(opt.font));
+      t.orderNumber = order;
+    }
+    return t;
+  }
+
+  static QFont orderFont(QFont f) {
+    f.setBold(true);
+    f.setItalic(true);
+    return f;
+  }
+
+  // top-left corner that centres `text` vertically in `r`
+  static QPointF centered(const QRect& r, const QStaticText& text) {
+    return QPointF(r.left(), r.top() + (r.height() - text.size().height()) / 2.0);
+  }
+
+  struct Layout {
+    QRect order;
+    QRect diag; // empty without findings
+    QRect title;
+    QRect buttons[ButtonCount];
+  };
+
+  static Layout layout(const QRect& rect, const QModelIndex& index) {
+    Layout l;
+    const QRect r = rect.adjusted(kMargin, 0, -kMargin, 0);
+    const int top = r.top() + (r.height() - kButtonSize) / 2;
+    int right = r.right() + 1;
+    for (int b = ButtonCount - 1; b >= 0; --b) {
+      right -= kButtonSize;
+      l.buttons[b] = QRect(right, top, kButtonSize, kButtonSize);
+      right -= kSpacing;
+    }
+    l.order = QRect(r.left(), r.top(), kOrderWidth, r.height());
+    int left = l.order.right() + 1 + kSpacing;
+    if (index.data(CommandModel::DiagnosticSeverityRole).toInt() != CommandModel::NoIssue) {
+      l.diag = QRect(left, r.top() + (r.height() - kIconSize) / 2, kIconSize, kIconSize);
+      left += kIconSize + kSpacing;
+    }
+    l.title = QRect(left, r.top(), std::max(0, right - left), r.height());
+    return l;
   }
+
+  static int buttonAt(const QRect& rect, const QModelIndex& index, const QPoint& pos) {
+    const Layout l = layout(rect, index);
+    for (int b = 0; b < ButtonCount; ++b) {
+      if (l.buttons[b].contains(pos)) return b;
+    }
+    return NoButton;
+  }
+
+  static void repaint(const QStyleOptionViewItem& option, const QModelIndex& index) {
+    if (auto* v = qobject_cast<QAbstractItemView*>(const_cast<QWidget*>(option.widget))) {
+      v->update(index);
+    }
+  }
+
+  static bool isEnabled(CommandModel* m, const QModelIndex& index, int b) {
+    const CommandRowWidget::Actions a = CommandRowWidget::actions(m, index);
+    return b == UpButton ? a.up : b == DownButton ? a.down : a.del;
+  }
+
+  mutable QHash<const CommandNode*, RowText> m_text; // keyed per node, checked by stamp
+  mutable QFont m_textFont;
+  QPersistentModelIndex m_active;
+  bool m_paintContent {true};
+  QPersistentModelIndex m_pressed;
+  int m_pressedButton {NoButton};
 };
 
 }
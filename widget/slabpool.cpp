@@ -0,0 +1,49 @@
+#include "slabpool.h"
+
+namespace rp {
+
+SlabPool::SlabPool(std::size_t blockSize, std::size_t blocksPerSlab)
+    : m_blockSize(blockSize < sizeof(FreeBlock) ? sizeof(FreeBlock) : blockSize)
+    , m_blocksPerSlab(blocksPerSlab ? blocksPerSlab : 1) {
+
+}
+
+void* SlabPool::allocate() {
+  std::lock_guard<std::mutex> guard(m_lock);
+  if (!m_free) {
+    grow();
+  }
+  FreeBlock* b = m_free;
+  m_free = b->next;
+  return b;
+}
+
+void SlabPool::deallocate(void* p) noexcept {
+  if (!p) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto* b = static_cast<FreeBlock*>(p);
+  b->next = m_free;
+  m_free = b;
+}
+
+std::size_t SlabPool::slabCount() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_slabs.size();
+}
+
+// Called with m_lock held. New blocks are threaded in address order so a
+// freshly built tree is laid out sequentially in memory.
+void SlabPool::grow() {
+  auto slab = std::make_unique<unsigned char[]>(m_blockSize * m_blocksPerSlab);
+  unsigned char* base = slab.get();
+  for (std::size_t i = m_blocksPerSlab; i-- > 0;) {
+    auto* b = reinterpret_cast<FreeBlock*>(base + i * m_blockSize);
+    b->next = m_free;
+    m_free = b;
+  }
+  m_slabs.push_back(std::move(slab));
+}
+
+} // namespace rp
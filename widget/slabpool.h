@@ -0,0 +1,93 @@
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace rp {
+
+/**
+ * Fixed-size block allocator
+ * Blocks are carved out of large slabs and recycled through an intrusive free
+ * list, so building or tearing down big trees costs one malloc per slab
+ * instead of one per node. Slabs are kept for the lifetime of the pool.
+*/
+class SlabPool {
+public:
+  explicit SlabPool(std::size_t blockSize, std::size_t blocksPerSlab = 4096);
+  SlabPool(const SlabPool&) = delete;
+  SlabPool& operator=(const SlabPool&) = delete;
+
+  void* allocate();
+  void deallocate(void* p) noexcept;
+
+  std::size_t blockSize() const { return m_blockSize; }
+  std::size_t slabCount() const;
+
+private:
+  struct FreeBlock { FreeBlock* next; };
+
+  void grow();
+
+  const std::size_t m_blockSize;
+  const std::size_t m_blocksPerSlab;
+  mutable std::mutex m_lock; // trees may be built on loader threads
+  FreeBlock* m_free {nullptr};
+  std::vector<std::unique_ptr<unsigned char[]>> m_slabs;
+};
+
+// One pool per block size class. Pools are intentionally leaked: nodes and
+// commands may still be released during static destruction.
+template <std::size_t Size, std::size_t Align>
+SlabPool& slabPoolFor() {
+  static_assert(Align <= alignof(std::max_align_t), "over-aligned types are not pooled");
+  constexpr std::size_t kGrain = alignof(std::max_align_t);
+  constexpr std::size_t kBlock = ((Size + kGrain - 1) / kGrain) * kGrain;
+  static SlabPool* pool = new SlabPool(kBlock);
+  return *pool;
+}
+
+// Allocator for std::allocate_shared: single-object requests (the object
+// together with its control block) come from a slab pool.
+template <class T>
+class PoolAllocator {
+public:
+  using value_type = T;
+
+  PoolAllocator() noexcept = default;
+  template <class U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    if (n == 1) {
+      return static_cast<T*>(slabPoolFor<sizeof(T), alignof(T)>().allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    if (n == 1) {
+      slabPoolFor<sizeof(T), alignof(T)>().deallocate(p);
+      return;
+    }
+    ::operator delete(p);
+  }
+
+  template <class U>
+  bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+  template <class U>
+  bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// Drop-in replacement for std::make_shared for fixed-size command types.
+template <class T, class... Args>
+std::shared_ptr<T> makePooled(Args&&... args) {
+  return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+} // namespace rp
+
+#endif // SLABPOOL_H
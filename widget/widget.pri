@@ -0,0 +1,51 @@
+# Command tree widgets and program model, shared by the application, the
+# tests and the benchmarks.
+INCLUDEPATH += $$PWD $$PWD/..
+
+SOURCES += \
+    $$PWD/childsource.cpp \
+    $$PWD/command.cpp \
+    $$PWD/commandeditor.cpp \
+    $$PWD/commandeditorpanel.cpp \
+    $$PWD/commandhistory.cpp \
+    $$PWD/commandmodel.cpp \
+    $$PWD/commandsearchindex.cpp \
+    $$PWD/commandtreeview.cpp \
+    $$PWD/executionengine.cpp \
+    $$PWD/flatcommandtree.cpp \
+    $$PWD/movelarrays.cpp \
+    $$PWD/movelkernels.cpp \
+    $$PWD/nametable.cpp \
+    $$PWD/programcompiler.cpp \
+    $$PWD/programfile.cpp \
+    $$PWD/programloader.cpp \
+    $$PWD/programtext.cpp \
+    $$PWD/programvalidator.cpp \
+    $$PWD/slabpool.cpp
+
+HEADERS += \
+    $$PWD/bytecode.h \
+    $$PWD/childsource.h \
+    $$PWD/command.h \
+    $$PWD/commandeditor.h \
+    $$PWD/commandeditorpanel.h \
+    $$PWD/commandhistory.h \
+    $$PWD/commandmodel.h \
+    $$PWD/commandnode.h \
+    $$PWD/commandrowwidget.h \
+    $$PWD/commandsearchindex.h \
+    $$PWD/commandtreeview.h \
+    $$PWD/executionengine.h \
+    $$PWD/flatcommandtree.h \
+    $$PWD/movelarrays.h \
+    $$PWD/movelkernels.h \
+    $$PWD/nametable.h \
+    $$PWD/nodeaggregate.h \
+    $$PWD/programcompiler.h \
+    $$PWD/programfile.h \
+    $$PWD/programloader.h \
+    $$PWD/programsnapshot.h \
+    $$PWD/programtext.h \
+    $$PWD/programvalidator.h \
+    $$PWD/rowdelegate.h \
+    $$PWD/slabpool.h